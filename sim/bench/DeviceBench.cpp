@@ -0,0 +1,127 @@
+/**
+ * Accesses/sec through DeviceMange, driven the way the "update devices" task
+ * drives it: update_outputs() for last cycle's requests, then update_inputs()
+ * for this cycle's port values.
+ *
+ * Only the DeviceMange and device constructor API is used, so the same file
+ * builds against older trees for a before/after comparison; drop the
+ * shutdown() call for trees without the device scheduler.
+ *
+ * usage: DeviceBench [cycles]
+ */
+#include "AMRTCDev.h"
+#include "AMUartDev.h"
+#include "DeviceMange.h"
+#include "SramMemoryDev.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+static constexpr uint64_t mem_base = 0x80000000;
+static constexpr uint64_t mem_size = 128 * 1024 * 1024;
+static constexpr uint64_t working_set = 1024 * 1024;
+static constexpr uint64_t rtc_addr = 0xa0000048;
+static constexpr uint64_t uart_addr = 0xa00003f8;
+static constexpr uint64_t extra_base = 0xa1000000;
+static constexpr uint64_t extra_devices = 64;
+
+struct BenchResult {
+  uint64_t accesses;
+  double seconds;
+  uint64_t checksum;
+};
+
+// mmio_shift: one read in 2^mmio_shift goes to mmio_addrs, round robin,
+// 0 for none
+static BenchResult run(SimDevices::DeviceMange &device_manager,
+                       const uint64_t cycles, const unsigned mmio_shift,
+                       std::span<const uint64_t> mmio_addrs = {}) {
+  uint64_t lcg = 0x9e3779b97f4a7c15ULL;
+  uint64_t checksum = 0;
+  uint64_t accesses = 0;
+  size_t mmio_idx = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+    checksum += device_manager.update_outputs();
+
+    lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+    const uint64_t offset = (lcg >> 16) % working_set & ~7ULL;
+    const bool to_mmio =
+        mmio_shift != 0 && (cycle & ((1ULL << mmio_shift) - 1)) == 0;
+    uint64_t raddr = mem_base + offset;
+    if (to_mmio) {
+      raddr = mmio_addrs[mmio_idx];
+      mmio_idx = mmio_idx + 1 == mmio_addrs.size() ? 0 : mmio_idx + 1;
+    }
+    const bool we = (cycle & 1) != 0;
+
+    device_manager.update_inputs(raddr, true,
+                                 {.waddr = mem_base + (offset ^ 0x40),
+                                  .wdata = lcg,
+                                  .wstrb = static_cast<uint8_t>(lcg >> 56)},
+                                 we);
+    accesses += we ? 2 : 1;
+  }
+  checksum += device_manager.update_outputs();
+  const auto end = std::chrono::steady_clock::now();
+
+  return {accesses, std::chrono::duration<double>(end - start).count(),
+          checksum};
+}
+
+static void report(std::string_view name, const BenchResult &result) {
+  std::cout << std::format("{:<16} {:>12} accesses {:>8.3f} s {:>8.2f} M/s "
+                           "(checksum {:#x})\n",
+                           name, result.accesses, result.seconds,
+                           result.accesses / result.seconds / 1e6,
+                           result.checksum);
+}
+
+int main(int argc, char **argv) {
+  const uint64_t cycles =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 0) : 50'000'000;
+
+  spdlog::stdout_color_mt("console");
+
+  auto device_manager = SimDevices::DeviceMange();
+  auto sim_mem = SimDevices::SynReadMemoryDev(mem_base, mem_size);
+  auto sim_am_uart = SimDevices::AMUartDev(uart_addr);
+  auto sim_am_rtc = SimDevices::AMRTCDev(rtc_addr);
+  device_manager.add_device(&sim_mem);
+  device_manager.add_device(&sim_am_uart);
+  device_manager.add_device(&sim_am_rtc);
+
+  // touch the working set first, page faults are not what is measured
+  run(device_manager, working_set / 8, 0);
+
+  report("ram", run(device_manager, cycles, 0));
+  const std::array<uint64_t, 1> rtc_only = {rtc_addr + 4};
+  report("ram+mmio", run(device_manager, cycles, 6, rtc_only));
+
+  // per-cycle cost should not depend on the number of devices
+  std::vector<SimDevices::AMRTCDev> extra_rtcs;
+  std::vector<uint64_t> extra_addrs;
+  extra_rtcs.reserve(extra_devices);
+  for (uint64_t i = 0; i < extra_devices; i++) {
+    extra_addrs.push_back(extra_base + i * 0x10 + 4);
+    extra_rtcs.emplace_back(extra_base + i * 0x10);
+  }
+  for (auto &rtc : extra_rtcs) {
+    device_manager.add_device(&rtc);
+  }
+  report(std::format("ram+mmio x{}", extra_devices + 3),
+         run(device_manager, cycles, 6, extra_addrs));
+
+  // the uart model is suspended in the scheduler, stop it while it is alive
+  device_manager.shutdown();
+  return 0;
+}
@@ -0,0 +1,326 @@
+/**
+ * Replays a --mem-trace recording through DeviceMange and, optionally, the
+ * L2 and DRAM timing models, without a Verilated core. mem_port requests are driven
+ * the way the "update devices" task drives them, one update_outputs() or
+ * tick() per cycle; DPI-C bursts go straight to the memory as in the
+ * simulator.
+ *
+ * With --file the memory starts from the same image as the recorded run and
+ * every RAM read is checked against the recorded data.
+ *
+ * usage: MemReplay <trace> [--file image] [--dram preset] [--l2 ...]
+ */
+#include "AMRTCDev.h"
+#include "AMUartDev.h"
+#include "CLI/CLI.hpp"
+#include "DeviceMange.h"
+#include "DramModel.h"
+#include "L2Cache.h"
+#include "L2Options.h"
+#include "MemTrace.h"
+#include "SramMemoryDev.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+
+// same map as the simulator, see main.cpp
+static constexpr uint64_t mem_base = 0x80000000;
+static constexpr uint64_t rtc_addr = 0xa0000048;
+static constexpr uint64_t uart_addr = 0xa00003f8;
+static constexpr uint64_t max_mismatch_reports = 16;
+
+struct ReplayStats {
+  uint64_t records = 0;
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t burst_reads = 0;
+  uint64_t burst_writes = 0;
+  // mem_port requests to devices the replay does not have, e.g. vga
+  uint64_t unrouted = 0;
+  uint64_t mismatches = 0;
+  uint64_t first_cycle = 0;
+  uint64_t last_cycle = 0;
+};
+
+class MemReplay {
+  SimDevices::DeviceMange &device_manager;
+  SimDevices::SynReadMemoryDev &sim_mem;
+  SimDevices::DramModel *dram;
+  SimDevices::L2Cache *l2;
+  bool verify;
+
+  // mem_port requests of one cycle, adjacent in the trace
+  struct PortCycle {
+    uint64_t cycle = 0;
+    bool read_en = false;
+    uint64_t raddr = 0;
+    uint64_t rdata = 0;
+    bool write_en = false;
+    SimDevices::WriteReq wreq{};
+  };
+  std::optional<PortCycle> port;
+
+  // the devices have seen every cycle up to here
+  uint64_t dev_cycle = 0;
+  bool started = false;
+
+  // RAM read of the port cycle being issued, checked on update_outputs()
+  struct ExpectedRead {
+    uint64_t addr;
+    uint64_t data;
+  };
+  std::optional<ExpectedRead> expected;
+
+  ReplayStats stats;
+
+  void mismatch(const uint64_t addr, const uint64_t expect,
+                const uint64_t actual) {
+    if (stats.mismatches++ < max_mismatch_reports) {
+      std::cout << std::format("read mismatch at {:#010x}: trace {:#018x}, "
+                               "replay {:#018x}\n",
+                               addr, expect, actual);
+    }
+  }
+
+  void device_outputs() {
+    const uint64_t rdata = device_manager.update_outputs();
+    if (expected.has_value()) {
+      if (rdata != expected->data) {
+        mismatch(expected->addr, expected->data, rdata);
+      }
+      expected.reset();
+    }
+  }
+
+  void advance_to(const uint64_t cycle) {
+    while (dev_cycle < cycle) {
+      dev_cycle++;
+      if (device_manager.idle()) {
+        device_manager.tick();
+      } else {
+        device_outputs();
+      }
+    }
+  }
+
+  bool routed(const uint64_t addr) const {
+    return sim_mem.in_range(addr) ||
+           device_manager.device_name(addr).has_value();
+  }
+
+  // the L2 forwards its misses to the DRAM model itself
+  void timing_access(const uint64_t cycle, const uint64_t addr,
+                     const uint32_t beats, const bool is_write) const {
+    if (!sim_mem.in_range(addr)) {
+      return;
+    }
+    if (l2 != nullptr) {
+      l2->access(cycle, addr, beats, is_write);
+    } else if (dram != nullptr) {
+      dram->access(cycle, addr, beats, is_write);
+    }
+  }
+
+  // the trace holds a mem_port request once it has completed, so it is
+  // issued and its outputs collected before the next record is replayed
+  void issue_port() {
+    if (!started) {
+      dev_cycle = port->cycle;
+      started = true;
+    }
+    advance_to(port->cycle);
+    device_manager.update_inputs(port->raddr, port->read_en, port->wreq,
+                                 port->write_en);
+    if (port->read_en) {
+      if (verify && sim_mem.in_range(port->raddr)) {
+        expected = {.addr = port->raddr, .data = port->rdata};
+      }
+      timing_access(port->cycle, port->raddr, 1, false);
+    }
+    if (port->write_en) {
+      timing_access(port->cycle, port->wreq.waddr, 1, true);
+    }
+    advance_to(port->cycle + 1);
+    port.reset();
+  }
+
+  void port_request(const SimDevices::MemTraceRecord &record) {
+    if (port.has_value() && port->cycle != record.cycle) {
+      issue_port();
+    }
+    if (!port.has_value()) {
+      port = PortCycle{.cycle = record.cycle};
+    }
+    if (!routed(record.addr)) {
+      stats.unrouted++;
+      return;
+    }
+    if (record.op == SimDevices::MemTraceOp::read) {
+      stats.reads++;
+      port->read_en = true;
+      port->raddr = record.addr;
+      port->rdata = record.data[0];
+    } else {
+      stats.writes++;
+      port->write_en = true;
+      port->wreq = {.waddr = record.addr,
+                    .wdata = record.data[0],
+                    .wstrb = static_cast<uint8_t>(record.strb)};
+    }
+  }
+
+  void burst_request(const SimDevices::MemTraceRecord &record) {
+    if (port.has_value()) {
+      issue_port();
+    }
+    if (record.op == SimDevices::MemTraceOp::burst_read) {
+      stats.burst_reads++;
+      if (verify) {
+        std::array<uint64_t, SimDevices::MemTraceRecord::max_beats> words{};
+        sim_mem.read_burst(record.addr, record.beats, words.data());
+        for (size_t i = 0; i < record.beats; i++) {
+          if (words[i] != record.data[i]) {
+            mismatch(record.addr + i * 8, record.data[i], words[i]);
+          }
+        }
+      }
+    } else {
+      stats.burst_writes++;
+      sim_mem.write_burst(record.addr, record.beats, record.data.data(),
+                          record.strb);
+    }
+    timing_access(record.cycle, record.addr, record.beats, record.is_write());
+  }
+
+public:
+  MemReplay(SimDevices::DeviceMange &device_manager,
+            SimDevices::SynReadMemoryDev &sim_mem,
+            SimDevices::DramModel *dram, SimDevices::L2Cache *l2,
+            const bool verify)
+      : device_manager(device_manager), sim_mem(sim_mem), dram(dram), l2(l2),
+        verify(verify) {}
+
+  void replay(const SimDevices::MemTraceRecord &record) {
+    // cycles in the trace are not strictly increasing
+    if (stats.records++ == 0) {
+      stats.first_cycle = record.cycle;
+      stats.last_cycle = record.cycle;
+    }
+    stats.first_cycle = std::min(stats.first_cycle, record.cycle);
+    stats.last_cycle = std::max(stats.last_cycle, record.cycle);
+    if (record.is_burst()) {
+      burst_request(record);
+    } else {
+      port_request(record);
+    }
+  }
+
+  void finish() {
+    if (port.has_value()) {
+      issue_port();
+    }
+  }
+
+  [[nodiscard]] const ReplayStats &get_stats() const { return stats; }
+};
+
+int main(int argc, char **argv) {
+  std::string trace_file;
+  std::string image_name;
+  uint64_t mem_size = 128 * 1024 * 1024;
+  std::string dram_preset;
+  auto l2_options = L2Options();
+
+  CLI::App app{"Replay a memory trace recorded with --mem-trace"};
+  app.add_option("trace", trace_file, "trace file")->required();
+  app.add_option("-f,--file", image_name,
+                 "image the recorded run was started from, enables read "
+                 "checking");
+  app.add_option("--mem-size", mem_size, "guest RAM size of the recorded run")
+      ->transform(CLI::AsSizeValue(false))
+      ->default_str("128M");
+  auto dram_presets = SimDevices::DramConfig::preset_names();
+  dram_presets.insert(dram_presets.begin(), "off");
+  app.add_option("--dram", dram_preset, "DRAM timing model for RAM accesses")
+      ->transform(CLI::IsMember(dram_presets, CLI::ignore_case))
+      ->default_val("off");
+  add_l2_options(app, l2_options);
+  CLI11_PARSE(app, argc, argv)
+
+  spdlog::stdout_color_mt("console");
+
+  auto device_manager = SimDevices::DeviceMange();
+  auto sim_mem = SimDevices::SynReadMemoryDev(mem_base, mem_size);
+  auto sim_am_uart = SimDevices::AMUartDev(uart_addr);
+  auto sim_am_rtc = SimDevices::AMRTCDev(rtc_addr);
+  device_manager.add_device(&sim_mem);
+  device_manager.add_device(&sim_am_uart);
+  device_manager.add_device(&sim_am_rtc);
+  if (!image_name.empty()) {
+    sim_mem.load_file(image_name.c_str());
+  }
+
+  auto dram = std::optional<SimDevices::DramModel>();
+  if (dram_preset != "off") {
+    dram.emplace(SimDevices::DramConfig::preset(dram_preset).value());
+  }
+  auto l2 = std::optional<SimDevices::L2Cache>();
+  if (l2_options.enable) {
+    l2.emplace(l2_options.config,
+               dram.has_value() ? &dram.value() : nullptr);
+  }
+
+  auto reader = SimDevices::MemTraceReader(trace_file);
+  if (!reader.is_open()) {
+    std::cout << std::format("{} is not a memory trace\n", trace_file);
+    return 1;
+  }
+
+  auto replay = MemReplay(device_manager, sim_mem,
+                          dram.has_value() ? &dram.value() : nullptr,
+                          l2.has_value() ? &l2.value() : nullptr,
+                          !image_name.empty());
+  auto record = SimDevices::MemTraceRecord();
+  const auto start = std::chrono::steady_clock::now();
+  while (reader.next(record)) {
+    replay.replay(record);
+  }
+  replay.finish();
+  const auto end = std::chrono::steady_clock::now();
+  device_manager.shutdown();
+
+  if (reader.is_truncated()) {
+    std::cout << "trace ends in the middle of a record\n";
+  }
+  const auto &stats = replay.get_stats();
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << std::format(
+      "{} records over {} cycles in {:.3f} s, {:.2f} M records/s\n",
+      stats.records, stats.last_cycle - stats.first_cycle, seconds,
+      stats.records / seconds / 1e6);
+  std::cout << std::format("mem_port: {} reads, {} writes, {} unrouted\n",
+                           stats.reads, stats.writes, stats.unrouted);
+  std::cout << std::format("bursts: {} reads, {} writes\n", stats.burst_reads,
+                           stats.burst_writes);
+  if (!image_name.empty()) {
+    std::cout << std::format("read mismatches: {}\n", stats.mismatches);
+  }
+  if (l2.has_value()) {
+    std::cout << std::format(
+        "L2: {} hits of {} accesses ({:.2f}%), {} misses, {} writebacks\n",
+        l2->hits, l2->accesses,
+        l2->accesses == 0 ? 0.0 : 100.0 * l2->hits / l2->accesses, l2->misses,
+        l2->writebacks);
+  }
+  if (dram.has_value()) {
+    dram->print_stats();
+  }
+  return stats.mismatches == 0 ? 0 : 1;
+}
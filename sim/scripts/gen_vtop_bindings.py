@@ -0,0 +1,168 @@
+"""
+Generate VtopBindings.h from the Verilated Vtop.h.
+
+The harness used to spell out io_difftest_bits_inst_info_0/1, every GPR and
+every CSR port by hand. This script reads the port list of Vtop.h and emits
+pointer tables for them, so a wider commit port in MonitorTop only needs a
+rebuild.
+
+usage: gen_vtop_bindings.py <Vtop.h> <VtopBindings.h>
+"""
+import re
+import sys
+
+PORT_RE = re.compile(r"VL_(?:IN|OUT)(8|16|64|W)?\(&(\w+),\s*(\d+),\s*(\d+)")
+
+C_TYPES = {"8": "CData", "16": "SData", None: "IData", "64": "QData"}
+
+INST_INFO_RE = re.compile(r"io_difftest_bits_inst_info_(\d+)_(pc|inst|is_rvc)$")
+GPR_RE = re.compile(r"io_difftest_bits_gpr_(\d+)$")
+CSR_RE = re.compile(r"io_difftest_bits_csr_(\w+)$")
+
+# csr port name -> address, see CSREncode.h
+CSR_ADDRS = {
+    "mstatus": 0x300,
+    "misa": 0x301,
+    "medeleg": 0x302,
+    "mideleg": 0x303,
+    "mie": 0x304,
+    "mtvec": 0x305,
+    "mscratch": 0x340,
+    "mepc": 0x341,
+    "mcause": 0x342,
+    "mtval": 0x343,
+    "mip": 0x344,
+    "stvec": 0x105,
+    "sscratch": 0x140,
+    "sepc": 0x141,
+    "scause": 0x142,
+    "stval": 0x143,
+    "satp": 0x180,
+    "dcsr": 0x7b0,
+    "dpc": 0x7b1,
+}
+
+# csrs without their own port, read through another one
+CSR_ALIASES = {
+    "sstatus": ("mstatus", 0x100),
+}
+
+
+def parse_ports(vtop_h):
+    ports = {}
+    with open(vtop_h) as f:
+        for line in f:
+            m = PORT_RE.search(line)
+            if m is None:
+                continue
+            width, name = m.group(1), m.group(2)
+            if width == "W":
+                # wide ports are arrays, never used by difftest
+                continue
+            ports[name] = C_TYPES[width]
+    return ports
+
+
+def collect(ports):
+    inst_info = {}
+    gprs = {}
+    csrs = {}
+    for name, c_type in ports.items():
+        if m := INST_INFO_RE.match(name):
+            inst_info.setdefault(int(m.group(1)), {})[m.group(2)] = (name, c_type)
+        elif m := GPR_RE.match(name):
+            gprs[int(m.group(1))] = (name, c_type)
+        elif (m := CSR_RE.match(name)) and m.group(1) in CSR_ADDRS:
+            csrs[m.group(1)] = (name, c_type)
+
+    width = len(inst_info)
+    if width == 0 or sorted(inst_info) != list(range(width)):
+        sys.exit(f"inst_info ports are not 0..N-1: {sorted(inst_info)}")
+    for idx, fields in inst_info.items():
+        if set(fields) != {"pc", "inst", "is_rvc"}:
+            sys.exit(f"inst_info_{idx} is missing fields: {sorted(fields)}")
+    if sorted(gprs) != list(range(32)):
+        sys.exit(f"expected 32 gpr ports, found {len(gprs)}")
+    return inst_info, gprs, csrs
+
+
+def emit(inst_info, gprs, csrs):
+    first = inst_info[0]
+    out = []
+    w = out.append
+    w("#pragma once")
+    w("")
+    w("// generated by scripts/gen_vtop_bindings.py from Vtop.h, do not edit")
+    w("")
+    w('#include "Vtop.h"')
+    w("#include <array>")
+    w("#include <cstddef>")
+    w("#include <cstdint>")
+    w("")
+    w("namespace VtopBindings {")
+    w(f"constexpr size_t commit_width = {len(inst_info)};")
+    w("constexpr size_t gpr_num = 32;")
+    w("")
+    w("struct InstInfoPorts {")
+    w(f"  const {first['pc'][1]} *pc;")
+    w(f"  const {first['inst'][1]} *inst;")
+    w(f"  const {first['is_rvc'][1]} *is_rvc;")
+    w("};")
+    w("")
+    w("struct CsrPort {")
+    w("  uint16_t addr;")
+    w("  const QData *port;")
+    w("};")
+    w("")
+    w("inline std::array<InstInfoPorts, commit_width> inst_info_ports(Vtop *top) {")
+    w("  return {{")
+    for idx in range(len(inst_info)):
+        f = inst_info[idx]
+        w(f"      {{&top->{f['pc'][0]}, &top->{f['inst'][0]},")
+        w(f"       &top->{f['is_rvc'][0]}}},")
+    w("  }};")
+    w("}")
+    w("")
+    w("inline std::array<const QData *, gpr_num> gpr_ports(Vtop *top) {")
+    w("  return {{")
+    for idx in range(32):
+        w(f"      &top->{gprs[idx][0]},")
+    w("  }};")
+    w("}")
+    w("")
+    # only 64-bit csrs, the 32-bit ones (dcsr) are not compared
+    csr_list = [(CSR_ADDRS[n], p) for n, (p, t) in csrs.items() if t == "QData"]
+    for alias, (target, addr) in CSR_ALIASES.items():
+        if target in csrs and csrs[target][1] == "QData":
+            csr_list.append((addr, csrs[target][0]))
+    csr_list.sort()
+    w(f"inline std::array<CsrPort, {len(csr_list)}> csr_ports(Vtop *top) {{")
+    w("  return {{")
+    for addr, port in csr_list:
+        w(f"      {{0x{addr:03x}, &top->{port}}},")
+    w("  }};")
+    w("}")
+    w("} // namespace VtopBindings")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f"usage: {sys.argv[0]} <Vtop.h> <VtopBindings.h>")
+    vtop_h, out_h = sys.argv[1], sys.argv[2]
+
+    text = emit(*collect(parse_ports(vtop_h)))
+
+    # keep the timestamp when nothing changed, avoids a full rebuild
+    try:
+        with open(out_h) as f:
+            if f.read() == text:
+                return
+    except FileNotFoundError:
+        pass
+    with open(out_h, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
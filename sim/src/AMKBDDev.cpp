@@ -1,16 +1,15 @@
 #include "include/AMKBDDev.h"
 #include "include/Utils.h"
-#include <SDL.h>
+#include <format>
 #include <iostream>
 #include <readerwriterqueue.h>
-#include <thread>
 
 namespace SimDevices {
 AMKBDDev::AMKBDDev(const uint64_t base_addr) {
   mem_addr = base_addr;
   mem_size = 8;
   scancode_queue = moodycamel::ReaderWriterQueue<int>(128);
-  ascii_queue = moodycamel::ReaderWriterQueue<SDL_Keycode>(128);
+  ascii_queue = moodycamel::ReaderWriterQueue<int32_t>(128);
 
   std::cout << std::format("am_keyboard at 0x{:x}\n", mem_addr);
 }
@@ -18,8 +17,8 @@ AMKBDDev::AMKBDDev(const uint64_t base_addr) {
 void AMKBDDev::update_inputs(const uint64_t read_addr, const bool read_en,
                              WriteReq write_req, const bool write_en) {
   if (read_en) {
-    MY_ASSERT(in_range(read_addr), "read address out of range");
-    read_req_seq.push_back(read_addr);
+    DEBUG_ASSERT(in_range(read_addr), "read address out of range");
+    read_slot.put(read_addr);
   }
   if (write_en) {
     MY_ASSERT(false, "write not supported");
@@ -27,11 +26,10 @@ void AMKBDDev::update_inputs(const uint64_t read_addr, const bool read_en,
 }
 
 uint64_t AMKBDDev::update_outputs() {
-  MY_ASSERT(write_req_seq.empty(), "write request not empty");
+  DEBUG_ASSERT(!write_slot.pending(), "write request not empty");
 
-  if (!read_req_seq.empty()) {
-    auto read_addr = read_req_seq.back();
-    read_req_seq.pop_back();
+  if (read_slot.pending()) {
+    auto read_addr = read_slot.take();
     auto offset = read_addr - mem_addr;
 
     MY_ASSERT(offset == 0 || offset == 4, "read offset not supported");
@@ -41,7 +39,7 @@ uint64_t AMKBDDev::update_outputs() {
       succeeded = scancode_queue.try_dequeue(am_code);
       last_read = succeeded ? am_code : 0;
     } else if (offset == 4) {
-      int sdl_code;
+      int32_t sdl_code;
       succeeded = ascii_queue.try_dequeue(sdl_code);
       last_read = succeeded ? sdl_code : 0;
     }
@@ -57,54 +55,15 @@ std::vector<AddrInfo> AMKBDDev::get_addr_info() {
   return {{mem_addr, mem_addr + mem_size, "am_keyboard"}};
 }
 
-void AMKBDDev::create_kdb_thread() {
-  std::thread writer([&] {
-    auto send_am_key = [&](const uint8_t scancode, const bool is_keydown) {
-      if (keymap[scancode] != 0) {
-#define KEYDOWN_MASK 0x8000
-        const int am_code = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
-        scancode_queue.enqueue(am_code);
-      }
-    };
-
-    auto send_ascii_key = [&](const SDL_Keycode kcode) {
-      // sdl keycode 包含 ascii 以外的内容
-      if (kcode <= UINT8_MAX) {
-        ascii_queue.enqueue(kcode);
-      }
-    };
-    SDL_Event event;
-    while (true) {
-      while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-        case SDL_QUIT:
-          break;
-        // If a key was pressed
-        case SDL_KEYDOWN:
-        case SDL_KEYUP: {
-          const SDL_Scancode k = event.key.keysym.scancode;
-          const bool is_keydown = event.key.type == SDL_KEYDOWN;
-          send_am_key(k, is_keydown);
-
-          if (event.type == SDL_KEYDOWN) {
-            // shift - 组合键 转换为 _
-            if (const SDL_Keycode k_ascii = SDL_GetKeyFromScancode(k);
-                event.key.keysym.mod & KMOD_SHIFT && k_ascii == SDLK_MINUS) {
-              send_ascii_key(SDLK_UNDERSCORE);
-            } else {
-              send_ascii_key(k_ascii);
-            }
-          }
-
-          break;
-        }
-        default:
-          break;
-        }
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-  });
-  writer.detach();
+void AMKBDDev::push_key(const KeyEvent &event) {
+  constexpr int keydown_mask = 0x8000;
+  if (event.scancode < std::size(keymap) && keymap[event.scancode] != 0) {
+    scancode_queue.enqueue(keymap[event.scancode] |
+                           (event.is_keydown ? keydown_mask : 0));
+  }
+  // sdl keycode 包含 ascii 以外的内容
+  if (event.ascii > 0 && event.ascii <= UINT8_MAX) {
+    ascii_queue.enqueue(event.ascii);
+  }
 }
 } // namespace SimDevices
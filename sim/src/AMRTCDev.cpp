@@ -15,8 +15,8 @@ AMRTCDev::AMRTCDev(uint64_t base_addr) {
 void AMRTCDev::update_inputs(uint64_t read_addr, bool read_en,
                              WriteReq write_req, bool write_en) {
   if (read_en) {
-    MY_ASSERT(in_range(read_addr), "read address out of range");
-    read_req_seq.push_back(read_addr);
+    DEBUG_ASSERT(in_range(read_addr), "read address out of range");
+    read_slot.put(read_addr);
   }
   if (write_en) {
     MY_ASSERT(false, "write not supported");
@@ -24,11 +24,10 @@ void AMRTCDev::update_inputs(uint64_t read_addr, bool read_en,
 }
 
 uint64_t AMRTCDev::update_outputs() {
-  MY_ASSERT(write_req_seq.empty(), "write request not empty");
+  DEBUG_ASSERT(!write_slot.pending(), "write request not empty");
 
-  if (!read_req_seq.empty()) {
-    auto read_addr = read_req_seq.back();
-    read_req_seq.pop_back();
+  if (read_slot.pending()) {
+    auto read_addr = read_slot.take();
     auto offset = read_addr - mem_addr;
 
     MY_ASSERT(offset == 0 || offset == 4, "read offset not supported");
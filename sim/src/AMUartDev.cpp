@@ -6,31 +6,52 @@
 // pub const RTC_ADDR: u64 = DEVICE_BASE + 0x0000048;
 namespace SimDevices {
 
-AMUartDev::AMUartDev(uint64_t base) {
+AMUartDev::AMUartDev(uint64_t base, const uint64_t tx_cycles)
+    : tx_cycles(tx_cycles) {
   mem_addr = base;
   mem_size = 8;
 }
 
+void AMUartDev::start_models() {
+  tx_event.bind(sched);
+  sched->spawn(tx_model());
+}
+
+async_simple::coro::Lazy<void> AMUartDev::tx_model() {
+  while (!sched->is_stopping()) {
+    co_await tx_event.wait();
+    while (!tx_fifo.empty()) {
+      std::cout << tx_fifo.front();
+      tx_fifo.pop_front();
+      co_await sched->delay(tx_cycles);
+    }
+  }
+}
+
 void AMUartDev::update_inputs(uint64_t read_addr, bool read_en,
                               WriteReq write_req, bool write_en) {
   if (read_en) {
     MY_ASSERT(false, "read not supported");
   }
   if (write_en) {
-    MY_ASSERT(in_range(write_req.waddr), "write address out of range");
-    write_req_seq.push_back(write_req);
+    DEBUG_ASSERT(in_range(write_req.waddr), "write address out of range");
+    write_slot.put(write_req);
   }
 }
 
 uint64_t AMUartDev::update_outputs() {
-  MY_ASSERT(read_req_seq.empty(), "read request not empty");
-  if (!write_req_seq.empty()) {
-    auto write_req = write_req_seq.back();
-    write_req_seq.pop_back();
+  DEBUG_ASSERT(!read_slot.pending(), "read request not empty");
+  if (write_slot.pending()) {
+    auto write_req = write_slot.take();
     auto offset = write_req.waddr - mem_addr;
     MY_ASSERT(offset == 0, "write address out of range");
     char c = static_cast<char>(write_req.wdata & 0xff);
-    std::cout << c;
+    if (attached()) {
+      tx_fifo.push_back(c);
+      tx_event.notify();
+    } else {
+      std::cout << c;
+    }
   }
 
   uint64_t ret = 0;
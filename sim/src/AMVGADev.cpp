@@ -1,14 +1,35 @@
 #include "include/AMVGADev.h"
 #include "SDL.h"
 #include "SDL_video.h"
+#include "include/AMKBDDev.h"
 #include "include/Utils.h"
+#include "spdlog/spdlog.h"
 #include <array>
 #include <bit>
+#include <cstring>
+#include <filesystem>
+#include <format>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 namespace SimDevices {
+struct AMVGADev::Screen {
+  std::thread thread;
+  std::atomic<bool> stop = false;
+  // keeps SDL_PushEvent out of the render thread's SDL_Quit
+  std::mutex wake_mutex;
+  // SDL user event that wakes the render thread, 0 while SDL is not up
+  Uint32 wake_event = 0;
+  // created, used and destroyed on the render thread
+  SDL_Window *window = nullptr;
+  SDL_Renderer *renderer = nullptr;
+  SDL_Texture *texture = nullptr;
+};
+
 AMVGADev::AMVGADev(uint64_t fb_addr_start, uint64_t ctrl_addr_start)
-    : fb_addr_start(fb_addr_start), ctrl_addr_start(ctrl_addr_start) {}
+    : fbbuff(new uint8_t[get_fb_size()]()), fb_addr_start(fb_addr_start),
+      ctrl_addr_start(ctrl_addr_start) {}
 
 bool AMVGADev::in_range(uint64_t addr) {
   return (addr >= fb_addr_start && addr < fb_addr_start + fb_addr_lenth) ||
@@ -42,11 +63,23 @@ void AMVGADev::write(uint64_t addr, uint64_t wdata, uint8_t wstrb) {
   if (addr >= fb_addr_start && addr < fb_addr_start + fb_addr_lenth) {
     auto offset = Utils::aligned_addr(addr) - fb_addr_start;
     MY_ASSERT(offset < get_fb_size(), "read address out of range");
+    if (capture_en) {
+      uint64_t old_word;
+      std::memcpy(&old_word, fbbuff + offset, sizeof(uint64_t));
+      fb_hash -= Utils::word_hash(offset, old_word);
+    }
     for (int i = 0; i < 8; i++) {
       if (wstrb & (1 << i)) {
         fbbuff[offset + i] = wdata_seq[i];
       }
     }
+    if (capture_en) {
+      uint64_t new_word;
+      std::memcpy(&new_word, fbbuff + offset, sizeof(uint64_t));
+      fb_hash += Utils::word_hash(offset, new_word);
+    }
+    // a pitch is a multiple of 8 bytes, the word is in a single row
+    dirty_rows.add(offset / get_pitch());
   }
   // control register area
   else if (addr >= ctrl_addr_start &&
@@ -70,66 +103,271 @@ void AMVGADev::write(uint64_t addr, uint64_t wdata, uint8_t wstrb) {
 void AMVGADev::update_inputs(uint64_t read_addr, bool read_en,
                              WriteReq write_req, bool write_en) {
   if (read_en) {
-    MY_ASSERT(in_range(read_addr), "read address out of range");
-    read_req_seq.push_back(read_addr);
+    DEBUG_ASSERT(in_range(read_addr), "read address out of range");
+    read_slot.put(read_addr);
   }
   if (write_en) {
-    MY_ASSERT(in_range(write_req.waddr), "write address out of range");
-    write_req_seq.push_back(write_req);
+    DEBUG_ASSERT(in_range(write_req.waddr), "write address out of range");
+    write_slot.put(write_req);
   }
 }
 
 uint64_t AMVGADev::update_outputs() {
-  if (!write_req_seq.empty()) {
-    auto write_req = write_req_seq.back();
-    write_req_seq.pop_back();
+  if (write_slot.pending()) {
+    auto write_req = write_slot.take();
     write(write_req.waddr, write_req.wdata, write_req.wstrb);
   }
-  if (!read_req_seq.empty()) {
-    auto read_addr = read_req_seq.back();
-    read_req_seq.pop_back();
+  if (read_slot.pending()) {
+    auto read_addr = read_slot.take();
     last_read = read(read_addr);
   }
   return last_read;
 }
 
-void AMVGADev::init_screen(std::string_view name) {
+void AMVGADev::init_screen(std::string_view name, AMKBDDev *kbd) {
+  for (auto &frame : frames) {
+    frame.pixels.resize(get_fb_size());
+  }
+  screen = std::make_unique<Screen>();
+  screen->thread =
+      std::thread(&AMVGADev::render_loop, this, std::string(name), kbd);
+}
+
+static void send_key(const SDL_Event &event, AMKBDDev *kbd) {
+  const SDL_Scancode scancode = event.key.keysym.scancode;
+  const bool is_keydown = event.type == SDL_KEYDOWN;
+  SDL_Keycode ascii = 0;
+  if (is_keydown) {
+    ascii = SDL_GetKeyFromScancode(scancode);
+    // shift - 组合键 转换为 _
+    if ((event.key.keysym.mod & KMOD_SHIFT) != 0 && ascii == SDLK_MINUS) {
+      ascii = SDLK_UNDERSCORE;
+    }
+  }
+  kbd->push_key({.scancode = static_cast<uint32_t>(scancode),
+                 .is_keydown = is_keydown,
+                 .ascii = ascii});
+}
+
+void AMVGADev::render_loop(const std::string &name, AMKBDDev *kbd) {
+  // SDL is initialized, used and shut down on this thread only
   SDL_Init(SDL_INIT_VIDEO);
-  SDL_CreateWindowAndRenderer(get_witdh() * 2, get_height() * 2, 0, &window,
-                              &renderer);
-  SDL_SetWindowTitle(window, name.data());
+  {
+    const std::lock_guard lock(screen->wake_mutex);
+    screen->wake_event = SDL_RegisterEvents(1);
+  }
+  SDL_CreateWindowAndRenderer(get_witdh() * 2, get_height() * 2, 0,
+                              &screen->window, &screen->renderer);
+  SDL_SetWindowTitle(screen->window, name.c_str());
+  screen->texture = SDL_CreateTexture(
+      screen->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+      get_witdh(), get_height());
+
+  // the texture starts undefined, the first frame is uploaded whole
+  bool first_frame = true;
+  while (!screen->stop.load(std::memory_order_acquire)) {
+    // publish_frame() wakes the wait, the timeout only bounds how long a
+    // frame published before the wake event existed can sit
+    SDL_Event event;
+    if (SDL_WaitEventTimeout(&event, 100) != 0) {
+      do {
+        if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) &&
+            kbd != nullptr) {
+          send_key(event, kbd);
+        }
+      } while (SDL_PollEvent(&event) != 0);
+    }
+    if ((frame_middle.load(std::memory_order_acquire) & frame_fresh) == 0) {
+      continue;
+    }
+    frame_front =
+        frame_middle.exchange(frame_front, std::memory_order_acq_rel) &
+        ~frame_fresh;
+    const auto &frame = frames[frame_front];
+    auto rows = frame.upload;
+    if (first_frame) {
+      rows = {.first = 0, .last = get_height()};
+      first_frame = false;
+    }
+    if (!rows.empty()) {
+      const SDL_Rect rect{.x = 0,
+                          .y = static_cast<int>(rows.first),
+                          .w = static_cast<int>(get_witdh()),
+                          .h = static_cast<int>(rows.last - rows.first)};
+      SDL_UpdateTexture(screen->texture, &rect,
+                        frame.pixels.data() + rows.first * get_pitch(),
+                        get_pitch());
+    }
+    SDL_RenderClear(screen->renderer);
+    SDL_RenderCopy(screen->renderer, screen->texture, nullptr, nullptr);
+    SDL_RenderPresent(screen->renderer);
+    frames_rendered.fetch_add(1, std::memory_order_relaxed);
+  }
 
-  texture =
-      SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-                        SDL_TEXTUREACCESS_STATIC, get_witdh(), get_height());
-  fbbuff = new uint8_t[get_fb_size()];
+  {
+    // a wake_render() still running finishes first, later ones see 0
+    const std::lock_guard lock(screen->wake_mutex);
+    screen->wake_event = 0;
+  }
+  SDL_DestroyTexture(screen->texture);
+  SDL_DestroyRenderer(screen->renderer);
+  SDL_DestroyWindow(screen->window);
+  SDL_Quit();
+}
+
+void AMVGADev::wake_render() {
+  const std::lock_guard lock(screen->wake_mutex);
+  if (screen->wake_event == 0 || screen->wake_event == UINT32_MAX) {
+    return;
+  }
+  // SDL_PushEvent is safe to call from any thread while SDL is up
+  SDL_Event event = {};
+  event.type = screen->wake_event;
+  SDL_PushEvent(&event);
+}
+
+void AMVGADev::publish_frame() {
+  for (auto &rows : stale_rows) {
+    rows.merge(dirty_rows);
+  }
+  // the last frame has been taken, the render thread's texture will hold it.
+  // If it is taken right after this check the rows are uploaded twice.
+  if ((frame_middle.load(std::memory_order_acquire) & frame_fresh) == 0) {
+    upload_rows.clear();
+  }
+  upload_rows.merge(dirty_rows);
+  dirty_rows.clear();
+
+  auto &frame = frames[frame_back];
+  auto &stale = stale_rows[frame_back];
+  if (!stale.empty()) {
+    std::memcpy(frame.pixels.data() + stale.first * get_pitch(),
+                fbbuff + stale.first * get_pitch(),
+                (stale.last - stale.first) * get_pitch());
+    stale.clear();
+  }
+  frame.upload = upload_rows;
+
+  const uint8_t old = frame_middle.exchange(frame_back | frame_fresh,
+                                            std::memory_order_acq_rel);
+  frame_back = old & ~frame_fresh;
+  if ((old & frame_fresh) != 0) {
+    // the render thread has not woken up for that one yet
+    frames_dropped++;
+  } else {
+    wake_render();
+  }
+  frames_published.fetch_add(1, std::memory_order_relaxed);
 }
 
 void AMVGADev::update_screen() {
   if ((vga_ctrl_reg >> 32) != 0) {
     vga_ctrl_reg &= 0xFFFFFFFFL;
-    SDL_UpdateTexture(texture, nullptr, fbbuff, get_witdh() * sizeof(uint32_t));
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-    SDL_RenderPresent(renderer);
+    if (capture_en) {
+      capture_frame();
+    }
+    if (screen != nullptr) {
+      publish_frame();
+    }
   }
 }
 
-AMVGADev::~AMVGADev() {
-  if (fbbuff != nullptr) {
-    delete[] fbbuff;
+void AMVGADev::enable_capture(const VGACaptureConfig &config,
+                              const uint64_t *cycle) {
+  MY_ASSERT(config.dump_every > 0, "vga dump interval must be at least 1\n");
+  capture = config;
+  this->cycle = cycle;
+  if (!capture.log_file.empty()) {
+    capture_log.open(capture.log_file, std::ios::trunc);
+    MY_ASSERT(capture_log.is_open(), "could not open vga log %s\n",
+              capture.log_file.c_str());
   }
-  if (renderer != nullptr) {
-    SDL_DestroyTexture(texture);
+  if (!capture.dump_dir.empty()) {
+    std::filesystem::create_directories(capture.dump_dir);
   }
-  if (texture != nullptr) {
-    SDL_DestroyRenderer(renderer);
+  fb_hash = 0;
+  for (uint64_t offset = 0; offset < get_fb_size(); offset += 8) {
+    uint64_t word;
+    std::memcpy(&word, fbbuff + offset, sizeof(uint64_t));
+    fb_hash += Utils::word_hash(offset, word);
   }
+  capture_en = true;
+}
+
+void AMVGADev::capture_frame() {
+  const uint64_t now = *cycle;
+  const auto now_time = std::chrono::steady_clock::now();
+  if (captured == 0) {
+    first_frame_cycle = now;
+    first_frame_time = now_time;
+  } else {
+    const uint64_t frame_cycles = now - last_frame_cycle;
+    min_frame_cycles = std::min(min_frame_cycles, frame_cycles);
+    max_frame_cycles = std::max(max_frame_cycles, frame_cycles);
+  }
+  last_frame_cycle = now;
+  last_frame_hash = fb_hash;
+  last_frame_time = now_time;
 
-  if (window != nullptr) {
-    SDL_DestroyWindow(window);
+  if (capture_log.is_open()) {
+    capture_log << std::format("{} {} {:016x}\n", captured, now, fb_hash);
+  }
+  if (!capture.dump_dir.empty() && captured % capture.dump_every == 0) {
+    dump_ppm(std::format("{}/frame_{:06}.ppm", capture.dump_dir, captured));
+  }
+  captured++;
+}
+
+void AMVGADev::dump_ppm(const std::string &path) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  MY_ASSERT(file.is_open(), "could not open %s\n", path.c_str());
+  const auto header = std::format("P6\n{} {}\n255\n", get_witdh(),
+                                  get_height());
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  // ARGB8888 words are stored B, G, R, A
+  auto rgb = std::vector<char>(get_witdh() * get_height() * 3);
+  for (uint64_t i = 0; i < get_witdh() * get_height(); i++) {
+    rgb[i * 3] = static_cast<char>(fbbuff[i * 4 + 2]);
+    rgb[i * 3 + 1] = static_cast<char>(fbbuff[i * 4 + 1]);
+    rgb[i * 3 + 2] = static_cast<char>(fbbuff[i * 4]);
+  }
+  file.write(rgb.data(), static_cast<std::streamsize>(rgb.size()));
+}
+
+void AMVGADev::print_stats() const {
+  const auto console = spdlog::get("console");
+  if (screen != nullptr) {
+    console->info("vga: {} frames, {} rendered, {} dropped",
+                  frames_published.load(std::memory_order_relaxed),
+                  frames_rendered.load(std::memory_order_relaxed),
+                  frames_dropped);
+  }
+  if (!capture_en) {
+    return;
+  }
+  console->info("vga capture: {} frames, last hash {:016x}", captured,
+                last_frame_hash);
+  if (captured > 1) {
+    const double seconds =
+        std::chrono::duration<double>(last_frame_time - first_frame_time)
+            .count();
+    console->info("vga capture: {:.2f} frames/s, cycles per frame {} avg, "
+                  "{} min, {} max",
+                  seconds == 0 ? 0.0 : (captured - 1) / seconds,
+                  (last_frame_cycle - first_frame_cycle) / (captured - 1),
+                  min_frame_cycles, max_frame_cycles);
+  }
+}
+
+AMVGADev::~AMVGADev() {
+  if (screen != nullptr) {
+    screen->stop.store(true, std::memory_order_release);
+    wake_render();
+    screen->thread.join();
+  }
+  if (fbbuff != nullptr) {
+    delete[] fbbuff;
   }
-  SDL_VideoQuit();
   std::cout << "AMVGADev exit\n";
 }
 
@@ -1,5 +1,9 @@
 #include "include/DeviceMange.h"
-#include "Utils.h"
+#include "include/CoDeviceBase.h"
+#include "include/MemTrace.h"
+#include "include/SramMemoryDev.h"
+#include "include/Utils.h"
+#include <algorithm>
 #include <format>
 #include <iostream>
 
@@ -18,58 +22,120 @@ void DeviceMange::add_device(DeviceBase *device) {
             device->get_addr_info()[0].name.c_str());
 
   device_pool.push_back(device);
+  for (const auto &[start, end, name] : device->get_addr_info()) {
+    routes.push_back({.start = start, .end = end, .device = device});
+  }
+  std::ranges::sort(routes, {}, &Route::start);
+
+  if (const auto mem = dynamic_cast<SynReadMemoryDev *>(device);
+      mem != nullptr && ram == nullptr) {
+    ram = mem;
+    ram_route = {.start = mem->get_mem_addr(),
+                 .end = mem->get_mem_addr() + mem->get_mem_size(),
+                 .device = mem};
+  }
+
+  if (const auto co_device = dynamic_cast<CoDeviceBase *>(device);
+      co_device != nullptr) {
+    co_device->attach(&scheduler);
+  }
+}
+
+DeviceBase *DeviceMange::find_device(const uint64_t addr) {
+  if (ram_route.contains(addr)) [[likely]] {
+    return ram;
+  }
+  if (mru_route.contains(addr)) {
+    return mru_route.device;
+  }
+  auto route = std::ranges::upper_bound(routes, addr, {}, &Route::start);
+  if (route == routes.begin()) {
+    return nullptr;
+  }
+  --route;
+  if (!route->contains(addr)) {
+    return nullptr;
+  }
+  mru_route = *route;
+  return route->device;
 }
 
 bool DeviceMange::update_inputs(uint64_t read_addr, const bool read_en,
                                 WriteReq write_req, const bool write_en) {
-  const auto rdevice =
-      std::ranges::find_if(device_pool, [&read_addr](auto item) {
-        return item->in_range(read_addr);
-      });
-
-  const auto wdevice =
-      std::ranges::find_if(device_pool, [&write_req](auto item) {
-        return item->in_range(write_req.waddr);
-      });
-
   bool success = true;
 
   if (read_en) {
-    if (rdevice != device_pool.end()) {
-      (*rdevice)->update_inputs(read_addr, read_en, write_req, false);
-    } else {
+    read_device = find_device(read_addr);
+    if (read_device == nullptr) [[unlikely]] {
       success = false;
       std::cout << std::format("read address out of range: {:#010X}\n",
                                read_addr);
+    } else if (read_device == ram) {
+      ram->update_inputs(read_addr, true, write_req, false);
+    } else {
+      read_device->update_inputs(read_addr, true, write_req, false);
     }
   }
 
   if (write_en) {
-    if (wdevice != device_pool.end()) {
-      (*wdevice)->update_inputs(read_addr, false, write_req, write_en);
-    } else {
+    write_device = find_device(write_req.waddr);
+    if (write_device == nullptr) [[unlikely]] {
       success = false;
       std::cout << std::format("write address out of range: {:#010X}\n",
                                write_req.waddr);
+    } else if (write_device == ram) {
+      ram->update_inputs(read_addr, false, write_req, true);
+    } else {
+      write_device->update_inputs(read_addr, false, write_req, true);
     }
   }
 
+  if (trace != nullptr) [[unlikely]] {
+    trace_cycle = trace->now();
+    trace_raddr = read_addr;
+    trace_wreq = write_req;
+  }
   return success;
 }
 
-uint64_t DeviceMange::update_outputs() const {
-  static uint64_t last_read = 0;
-  for (const auto device : device_pool) {
-    if (!device->read_req_seq.empty()) {
-      last_read = device->update_outputs();
-    }
-    if (!device->write_req_seq.empty()) {
-      device->update_outputs();
-    }
+uint64_t DeviceMange::device_outputs(DeviceBase *device) {
+  if (device == ram) [[likely]] {
+    return ram->update_outputs();
+  }
+  return device->update_outputs();
+}
+
+uint64_t DeviceMange::update_outputs() {
+  tick();
+
+  // a device drains both of its slots in one update_outputs()
+  if (read_device != nullptr) {
+    last_read = device_outputs(read_device);
+  }
+  if (write_device != nullptr && write_device != read_device) {
+    device_outputs(write_device);
+  }
+  if (trace != nullptr) [[unlikely]] {
+    trace_requests();
   }
+  DEBUG_ASSERT(read_device == nullptr || !read_device->has_pending(),
+               "read device still has pending requests\n");
+  read_device = nullptr;
+  write_device = nullptr;
   return last_read;
 }
 
+void DeviceMange::trace_requests() {
+  if (write_device != nullptr) {
+    trace->record(trace_cycle, MemTraceOp::write, trace_wreq.waddr, 1,
+                  trace_wreq.wstrb, &trace_wreq.wdata);
+  }
+  if (read_device != nullptr) {
+    trace->record(trace_cycle, MemTraceOp::read, trace_raddr, 1, 0,
+                  &last_read);
+  }
+}
+
 void DeviceMange::print_device_info() const {
   std::cout << "Device Info:\n";
   for (const auto device : device_pool) {
@@ -82,17 +148,23 @@ void DeviceMange::print_device_info() const {
   std::cout << "---------------------------------------------\n";
 }
 
-bool DeviceMange::is_conflict(const uint64_t start, const uint64_t end) const {
+std::optional<std::string> DeviceMange::device_name(const uint64_t addr) const {
   for (const auto device : device_pool) {
     for (auto addr_info = device->get_addr_info();
-         const auto &info : addr_info) {
-      // Check if there is any overlap between [start, end) and [info.start,
-      // info.end)
-      if (start < info.end && end > info.start) {
-        return true;
+         auto &[start, end, name] : addr_info) {
+      if (addr >= start && addr < end) {
+        return name;
       }
     }
   }
-  return false;
+  return std::nullopt;
+}
+
+bool DeviceMange::is_conflict(const uint64_t start, const uint64_t end) const {
+  // Check if there is any overlap between [start, end) and [route.start,
+  // route.end)
+  return std::ranges::any_of(routes, [start, end](const Route &route) {
+    return start < route.end && end > route.start;
+  });
 }
 } // namespace SimDevices
@@ -0,0 +1,64 @@
+#include "include/DeviceScheduler.h"
+#include "include/Utils.h"
+#include <utility>
+
+namespace SimDevices {
+
+bool DeviceEvent::Awaiter::await_ready() const noexcept {
+  return event->sched->is_stopping();
+}
+
+void DeviceEvent::Awaiter::await_suspend(
+    const std::coroutine_handle<> handle) const {
+  event->waiters.push_back(handle);
+  if (!event->parked) {
+    event->parked = true;
+    event->sched->parked_events.push_back(event);
+  }
+}
+
+void DeviceEvent::notify() {
+  DEBUG_ASSERT(sched != nullptr, "event not bound to a scheduler\n");
+  for (const auto handle : waiters) {
+    sched->wake_at(sched->now, handle);
+  }
+  waiters.clear();
+}
+
+void DeviceScheduler::spawn(async_simple::coro::Lazy<void> model) {
+  running++;
+  std::move(model).start([this](async_simple::Try<void> &&result) {
+    MY_ASSERT(!result.hasError(), "device model exited with an exception\n");
+    running--;
+  });
+}
+
+void DeviceScheduler::wake_at(const uint64_t cycle,
+                              const std::coroutine_handle<> handle) {
+  wakeups.push({cycle, wakeup_seq++, handle});
+}
+
+void DeviceScheduler::resume_due() {
+  // a resumed model may queue itself again for this cycle, e.g. notify()
+  // of another model's event, it still runs in this tick
+  while (!wakeups.empty() && wakeups.top().cycle <= now) {
+    const auto handle = wakeups.top().handle;
+    wakeups.pop();
+    handle.resume();
+  }
+}
+
+void DeviceScheduler::shutdown() {
+  stopping = true;
+  for (const auto event : parked_events) {
+    event->notify();
+  }
+  // nothing suspends any more, every model runs to its end
+  while (!wakeups.empty()) {
+    const auto handle = wakeups.top().handle;
+    wakeups.pop();
+    handle.resume();
+  }
+  MY_ASSERT(running == 0, "%zu device models did not stop\n", running);
+}
+} // namespace SimDevices
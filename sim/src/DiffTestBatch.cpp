@@ -0,0 +1,160 @@
+#include "include/DiffTestBatch.h"
+
+DiffTestBatch::DiffTestBatch(DiffTest &diff_ref, const uint64_t batch_size,
+                             const uint64_t replay_limit)
+    : diff_ref(diff_ref), batch_size(batch_size), replay_limit(replay_limit) {
+  console = spdlog::get("console");
+  batch.reserve(batch_size);
+}
+
+void DiffTestBatch::log_steps(const uint64_t steps) {
+  good_steps += steps;
+  if (!replay_en) {
+    return;
+  }
+  if (!replay_log.empty() && replay_log.back().kind == ReplayEvent::step) {
+    replay_log.back().arg += steps;
+  } else {
+    replay_log.push_back({.kind = ReplayEvent::step, .arg = steps});
+  }
+}
+
+void DiffTestBatch::log_event(const ReplayEvent &event) {
+  if (!replay_en) {
+    return;
+  }
+  if (replay_limit != 0 && replay_events == replay_limit) {
+    console->warn("DiffTest batch: replay log reached {} skips, dropped, "
+                  "mismatches will not be narrowed down to one commit",
+                  replay_limit);
+    replay_en = false;
+    replay_log = {};
+    skip_records = {};
+    return;
+  }
+  replay_events++;
+  replay_log.push_back(event);
+}
+
+bool DiffTestBatch::push(const DiffCommit &commit) {
+  const bool need_exact =
+      commit.has_mmio || commit.csr_skip || commit.has_interrupt;
+  if (!need_exact) {
+    roll = diff_roll_hash(roll, commit.state.hash());
+    batch.push_back({.seq = commit.seq,
+                     .cycle = commit.cycle,
+                     .pc = commit.state.pc,
+                     .commit_num = commit.commit_num,
+                     .roll = roll});
+    pending_steps += commit.commit_num;
+    last_commit = commit;
+    return pending_steps < batch_size || flush();
+  }
+
+  if (!flush()) {
+    return false;
+  }
+
+  exact_check_num++;
+  const bool mismatch = diff_ref.check_commit(commit);
+  if (commit.has_mmio || commit.csr_skip) {
+    log_event({.kind = ReplayEvent::skip, .arg = skip_records.size()});
+    if (replay_en) {
+      auto &record = skip_records.emplace_back(SkipRecord{
+          .next_pc = commit.next_pc,
+          .commit_num = commit.commit_num,
+          .dest_gpr = commit.dest_gpr,
+          .dest_value = {}});
+      for (size_t idx = 0; idx < commit.commit_num; idx++) {
+        record.dest_value[idx] = commit.state.gpr[commit.dest_gpr[idx]];
+      }
+    }
+  } else {
+    log_steps(commit.commit_num);
+    if (commit.has_interrupt) {
+      log_event({.kind = ReplayEvent::intr, .arg = commit.cause & 0xffff});
+    }
+  }
+  return !mismatch;
+}
+
+bool DiffTestBatch::flush() {
+  if (batch.empty()) {
+    return true;
+  }
+
+  diff_ref.step(pending_steps);
+  batch_num++;
+  // the batch was not checked commit by commit, compare everything
+  const bool mismatch = diff_ref.check_state(last_commit, true);
+  if (mismatch) {
+    replay();
+  } else {
+    log_steps(pending_steps);
+    batch_start_roll = roll;
+  }
+
+  batch.clear();
+  pending_steps = 0;
+  return !mismatch;
+}
+
+void DiffTestBatch::replay() {
+  if (!replay_en) {
+    console->critical("DiffTest batch mismatch after {} good steps, replay "
+                      "log was dropped",
+                      good_steps);
+    return;
+  }
+  console->warn("DiffTest batch mismatch, replay {} steps from boot, then {} "
+                "commits one by one",
+                good_steps, batch.size());
+
+  diff_ref.reset();
+  for (const auto &event : replay_log) {
+    switch (event.kind) {
+    case ReplayEvent::step:
+      diff_ref.step(event.arg);
+      break;
+    case ReplayEvent::skip: {
+      // the reference matched the DUT before the skip, only the
+      // destinations differ, also with --diff-skip=full
+      const auto &record = skip_records[event.arg];
+      diff_ref.set_pc(record.next_pc);
+      for (size_t idx = 0; idx < record.commit_num; idx++) {
+        if (const auto rd = record.dest_gpr[idx]; rd != 0) {
+          diff_ref.set_reg(rd, record.dest_value[idx]);
+        }
+      }
+      break;
+    }
+    case ReplayEvent::intr:
+      diff_ref.raise_intr(event.arg);
+      break;
+    }
+  }
+
+  ArchState ref_state{};
+  auto ref_roll = batch_start_roll;
+  for (const auto &entry : batch) {
+    diff_ref.step(entry.commit_num);
+    diff_ref.get_state(ref_state);
+    ref_roll = diff_roll_hash(ref_roll, ref_state.hash());
+    if (ref_roll != entry.roll) {
+      console->critical("DiffTest first divergent commit {} at cycle {}, "
+                        "dut pc: 0x{:016x}, ref pc: 0x{:016x}",
+                        entry.seq, entry.cycle, entry.pc, ref_state.pc);
+      return;
+    }
+  }
+  console->critical("DiffTest replay did not reproduce the mismatch, the "
+                    "reference is not deterministic");
+}
+
+void DiffTestBatch::print_stats() const {
+  console->info("DiffTest batch: {} batches, {} exact checks, {} replay "
+                "events, {} skip records ({} KiB)",
+                batch_num, exact_check_num, replay_log.size(),
+                skip_records.size(),
+                skip_records.size() * sizeof(SkipRecord) / 1024);
+}
@@ -0,0 +1,83 @@
+#include "include/DiffTestMem.h"
+#include "include/Utils.h"
+#include <cstring>
+
+DiffTestMem::DiffTestMem(DiffTest &diff_ref,
+                         SimDevices::SynReadMemoryDev &sim_mem)
+    : diff_ref(diff_ref), sim_mem(sim_mem),
+      page_buf(SimDevices::SynReadMemoryDev::page_size) {
+  console = spdlog::get("console");
+  sim_mem.enable_page_hash();
+}
+
+uint64_t DiffTestMem::ref_word(const uint64_t addr) const {
+  uint64_t value = 0;
+  diff_ref.read_mem(addr, reinterpret_cast<uint8_t *>(&value), sizeof(value));
+  return value;
+}
+
+void DiffTestMem::check_word(const uint64_t addr, const uint64_t mask) {
+  if (addr == to_host_addr) {
+    // cleared by the simulator, never by the program
+    return;
+  }
+  const auto dut_value = sim_mem.read(addr) & mask;
+  const auto ref_value = ref_word(addr) & mask;
+  if (dut_value != ref_value) {
+    next_suspects.push_back({.addr = addr,
+                             .mask = mask,
+                             .dut_value = dut_value,
+                             .ref_value = ref_value});
+  }
+}
+
+void DiffTestMem::check_pages() {
+  constexpr auto page_size = SimDevices::SynReadMemoryDev::page_size;
+  for (const auto page_addr : sim_mem.get_dirty_pages()) {
+    page_check_num++;
+    diff_ref.read_mem(page_addr, page_buf.data(), page_size);
+
+    uint64_t ref_hash = 0;
+    for (uint64_t offset = 0; offset < page_size; offset += 8) {
+      uint64_t value;
+      std::memcpy(&value, &page_buf[offset], sizeof(value));
+      ref_hash += Utils::word_hash(page_addr + offset, value);
+    }
+    if (ref_hash == sim_mem.get_page_hash(page_addr)) [[likely]] {
+      continue;
+    }
+
+    // narrow the page down to words
+    for (uint64_t offset = 0; offset < page_size; offset += 8) {
+      check_word(page_addr + offset, ~0ULL);
+    }
+  }
+}
+
+bool DiffTestMem::check() {
+  check_num++;
+  to_host_addr = sim_mem.get_to_host_addr();
+
+  // confirm the suspects of the last check first
+  for (const auto &suspect : suspects) {
+    const auto dut_value = sim_mem.read(suspect.addr) & suspect.mask;
+    const auto ref_value = ref_word(suspect.addr) & suspect.mask;
+    if (dut_value == suspect.dut_value && ref_value != dut_value) {
+      console->critical("DiffTest memory mismatch at 0x{:016x}, ref value: "
+                        "0x{:016x}, dut value: 0x{:016x}, mask: 0x{:016x}",
+                        suspect.addr, ref_value, dut_value, suspect.mask);
+      return false;
+    }
+  }
+
+  next_suspects.clear();
+  check_pages();
+  sim_mem.clear_dirty_pages();
+  std::swap(suspects, next_suspects);
+  return true;
+}
+
+void DiffTestMem::print_stats() const {
+  console->info("DiffTest memory: {} checks, {} pages compared", check_num,
+                page_check_num);
+}
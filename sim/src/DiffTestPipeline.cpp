@@ -0,0 +1,77 @@
+#include "include/DiffTestPipeline.h"
+#include <chrono>
+
+DiffTestPipeline::DiffTestPipeline(DiffTest &diff_ref,
+                                   const size_t max_inflight)
+    : diff_ref(diff_ref), queue(max_inflight), max_inflight(max_inflight) {
+  console = spdlog::get("console");
+}
+
+DiffTestPipeline::~DiffTestPipeline() { stop(); }
+
+void DiffTestPipeline::start() {
+  stop_requested.store(false, std::memory_order_relaxed);
+  ref_thread = std::thread([this] { ref_loop(); });
+}
+
+void DiffTestPipeline::stop() {
+  if (!ref_thread.joinable()) {
+    return;
+  }
+  stop_requested.store(true, std::memory_order_release);
+  ref_thread.join();
+}
+
+void DiffTestPipeline::check(const DiffCommit &commit) {
+  // the reference is no longer in lock step after a mismatch, keep draining
+  // so the sim thread never blocks on a full queue
+  if (!mismatch_found.load(std::memory_order_relaxed) &&
+      diff_ref.check_commit(commit)) {
+    first_mismatch = commit;
+    mismatch_found.store(true, std::memory_order_release);
+  }
+  checked_num.fetch_add(1, std::memory_order_release);
+}
+
+void DiffTestPipeline::ref_loop() {
+  DiffCommit commit;
+  while (true) {
+    if (queue.wait_dequeue_timed(commit, std::chrono::milliseconds(10))) {
+      check(commit);
+    } else if (stop_requested.load(std::memory_order_acquire)) {
+      // commits pushed right before the stop request
+      while (queue.try_dequeue(commit)) {
+        check(commit);
+      }
+      break;
+    }
+  }
+}
+
+bool DiffTestPipeline::push(const DiffCommit &commit) {
+  if (!ref_thread.joinable()) [[unlikely]] {
+    start();
+  }
+  queue.wait_enqueue(commit);
+  pushed_num++;
+  return !has_mismatch();
+}
+
+bool DiffTestPipeline::sync() {
+  while (checked_num.load(std::memory_order_acquire) < pushed_num) {
+    std::this_thread::yield();
+  }
+  return !has_mismatch();
+}
+
+void DiffTestPipeline::report_mismatch() const {
+  if (!has_mismatch()) {
+    return;
+  }
+  console->critical("DiffTest pipeline: first divergent commit {} at cycle {}, "
+                    "pc: 0x{:016x}",
+                    first_mismatch.seq, first_mismatch.cycle,
+                    first_mismatch.state.pc);
+  console->critical("DUT halted {} commits later (max in flight: {})",
+                    pushed_num - 1 - first_mismatch.seq, max_inflight);
+}
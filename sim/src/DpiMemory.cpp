@@ -0,0 +1,86 @@
+#include "include/DpiMemory.h"
+#include "include/Utils.h"
+#include "svdpi.h"
+#include <array>
+#include <cstring>
+
+// imported by dpi_mem_line.v, see AXI4DpiMemory.scala
+extern "C" {
+int dpi_mem_read_line(long long addr, int beats, svBitVecVal *line);
+int dpi_mem_write_line(long long addr, int beats, const svBitVecVal *line,
+                       long long strb);
+}
+
+static constexpr size_t max_beats = 8;
+
+static SimDevices::SynReadMemoryDev *dpi_mem = nullptr;
+static SimDevices::DramModel *dpi_dram = nullptr;
+static SimDevices::L2Cache *dpi_l2 = nullptr;
+static const uint64_t *dpi_cycle = nullptr;
+static SimDevices::MemTraceWriter *dpi_trace = nullptr;
+static uint64_t dpi_burst_num = 0;
+
+namespace SimDevices {
+void bind_dpi_memory(SynReadMemoryDev *mem) { dpi_mem = mem; }
+
+void bind_dpi_dram(DramModel *dram, const uint64_t *cycle) {
+  dpi_dram = dram;
+  dpi_cycle = cycle;
+}
+
+void bind_dpi_l2(L2Cache *l2, const uint64_t *cycle) {
+  dpi_l2 = l2;
+  dpi_cycle = cycle;
+}
+
+void bind_dpi_trace(MemTraceWriter *trace) { dpi_trace = trace; }
+
+uint64_t dpi_bursts() { return dpi_burst_num; }
+} // namespace SimDevices
+
+// the L2 forwards its misses to the DRAM model itself
+static int mem_latency(const uint64_t addr, const int beats,
+                       const bool is_write) {
+  if (dpi_l2 != nullptr) {
+    return static_cast<int>(dpi_l2->access(*dpi_cycle, addr, beats, is_write));
+  }
+  if (dpi_dram != nullptr) {
+    return static_cast<int>(
+        dpi_dram->access(*dpi_cycle, addr, beats, is_write));
+  }
+  return 0;
+}
+
+// line is bit [511:0], 32-bit words with the lowest first, so beat i is at
+// byte 8 * i on a little-endian host
+int dpi_mem_read_line(const long long addr, const int beats,
+                      svBitVecVal *line) {
+  DEBUG_ASSERT(dpi_mem != nullptr, "dpi memory not bound\n");
+  DEBUG_ASSERT(beats > 0 && static_cast<size_t>(beats) <= max_beats,
+               "bad burst length %d\n", beats);
+  std::array<uint64_t, max_beats> words{};
+  dpi_mem->read_burst(addr, beats, words.data());
+  dpi_burst_num++;
+  if (dpi_trace != nullptr) [[unlikely]] {
+    dpi_trace->record(dpi_trace->now(), SimDevices::MemTraceOp::burst_read,
+                      addr, beats, 0, words.data());
+  }
+  std::memcpy(line, words.data(), sizeof(words));
+  return mem_latency(addr, beats, false);
+}
+
+int dpi_mem_write_line(const long long addr, const int beats,
+                       const svBitVecVal *line, const long long strb) {
+  DEBUG_ASSERT(dpi_mem != nullptr, "dpi memory not bound\n");
+  DEBUG_ASSERT(beats > 0 && static_cast<size_t>(beats) <= max_beats,
+               "bad burst length %d\n", beats);
+  std::array<uint64_t, max_beats> words{};
+  std::memcpy(words.data(), line, sizeof(words));
+  dpi_mem->write_burst(addr, beats, words.data(), strb);
+  dpi_burst_num++;
+  if (dpi_trace != nullptr) [[unlikely]] {
+    dpi_trace->record(dpi_trace->now(), SimDevices::MemTraceOp::burst_write,
+                      addr, beats, strb, words.data());
+  }
+  return mem_latency(addr, beats, true);
+}
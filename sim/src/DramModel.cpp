@@ -0,0 +1,181 @@
+#include "include/DramModel.h"
+#include "include/Utils.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <bit>
+
+namespace SimDevices {
+
+static const std::array<DramConfig, 3> dram_presets = {{
+    {.name = "ddr3-1600",
+     .banks = 8,
+     .row_bytes = 8192,
+     .t_cas = 14,
+     .t_rcd = 14,
+     .t_rp = 14,
+     .t_burst = 1,
+     .t_refi = 7800,
+     .t_rfc = 260,
+     .queue_depth = 16},
+    {.name = "ddr4-2400",
+     .banks = 16,
+     .row_bytes = 8192,
+     .t_cas = 14,
+     .t_rcd = 14,
+     .t_rp = 14,
+     .t_burst = 1,
+     .t_refi = 7800,
+     .t_rfc = 350,
+     .queue_depth = 32},
+    {.name = "lpddr4-3200",
+     .banks = 8,
+     .row_bytes = 2048,
+     .t_cas = 18,
+     .t_rcd = 18,
+     .t_rp = 21,
+     .t_burst = 1,
+     .t_refi = 3900,
+     .t_rfc = 280,
+     .queue_depth = 32},
+}};
+
+std::optional<DramConfig> DramConfig::preset(const std::string_view name) {
+  for (const auto &config : dram_presets) {
+    if (config.name == name) {
+      return config;
+    }
+  }
+  return std::nullopt;
+}
+
+std::vector<std::string> DramConfig::preset_names() {
+  std::vector<std::string> names;
+  for (const auto &config : dram_presets) {
+    names.push_back(config.name);
+  }
+  return names;
+}
+
+DramModel::DramModel(const DramConfig &config)
+    : config(config), next_refresh(config.t_refi) {
+  MY_ASSERT(std::has_single_bit(config.banks) &&
+                std::has_single_bit(config.row_bytes),
+            "dram banks and row size must be powers of two\n");
+  MY_ASSERT(config.queue_depth > 0, "dram queue depth must not be 0\n");
+  row_shift = std::countr_zero(config.row_bytes);
+  bank_mask = config.banks - 1;
+  banks.resize(config.banks);
+  inflight.resize(config.queue_depth, 0);
+}
+
+void DramModel::refresh_until(const uint64_t now) {
+  if (config.t_refi == 0 || now < next_refresh) [[likely]] {
+    return;
+  }
+  // only the last refresh before now can still keep a bank busy, the ones
+  // in between are just counted
+  const uint64_t count = (now - next_refresh) / config.t_refi + 1;
+  const uint64_t last = next_refresh + (count - 1) * config.t_refi;
+  for (auto &bank : banks) {
+    bank.row_open = false;
+    bank.ready = std::max(bank.ready, last + config.t_rfc);
+  }
+  next_refresh = last + config.t_refi;
+  stats.refreshes += count;
+}
+
+uint32_t DramModel::access(const uint64_t now, const uint64_t addr,
+                           const uint32_t beats, const bool is_write) {
+  refresh_until(now);
+
+  // row:bank:column, consecutive rows go to different banks
+  const uint64_t row_idx = addr >> row_shift;
+  auto &bank = banks[row_idx & bank_mask];
+  const uint64_t row = row_idx >> std::countr_zero(config.banks);
+
+  uint64_t start = std::max(now, bank.ready);
+  // at most queue_depth bursts in flight, wait for the oldest one
+  if (inflight[inflight_head] > start) {
+    start = inflight[inflight_head];
+    stats.queue_stalls++;
+  }
+
+  uint64_t access_cycles = config.t_cas;
+  if (!bank.row_open) {
+    access_cycles += config.t_rcd;
+    stats.row_empty++;
+  } else if (bank.row != row) {
+    access_cycles += config.t_rp + config.t_rcd;
+    stats.row_conflicts++;
+  } else {
+    stats.row_hits++;
+  }
+
+  const uint64_t data_start = std::max(start + access_cycles, bus_free);
+  const uint64_t done = data_start + beats * config.t_burst;
+  bus_free = done;
+  bank.row_open = true;
+  bank.row = row;
+  bank.ready = data_start;
+  inflight[inflight_head] = done;
+  inflight_head = inflight_head + 1 == inflight.size() ? 0 : inflight_head + 1;
+
+  const uint64_t latency = (is_write ? done : data_start) - now;
+  const size_t bucket =
+      std::min<size_t>(std::bit_width(latency), DramStats::hist_buckets - 1);
+  if (is_write) {
+    stats.writes++;
+    stats.write_latency_sum += latency;
+    stats.write_hist[bucket]++;
+  } else {
+    stats.reads++;
+    stats.read_latency_sum += latency;
+    stats.read_hist[bucket]++;
+  }
+  if (stats.reads + stats.writes == 1) {
+    stats.first_cycle = now;
+  }
+  stats.last_cycle = std::max(stats.last_cycle, done);
+  stats.bytes += beats * 8;
+
+  return static_cast<uint32_t>(latency);
+}
+
+void DramModel::print_stats() const {
+  const auto console = spdlog::get("console");
+  const uint64_t accesses = stats.reads + stats.writes;
+  console->info("DRAM {}: {} reads, {} writes, {} refreshes, {} queue stalls",
+                config.name, stats.reads, stats.writes, stats.refreshes,
+                stats.queue_stalls);
+  if (accesses == 0) {
+    return;
+  }
+
+  const uint64_t cycles = stats.last_cycle - stats.first_cycle;
+  console->info("DRAM bandwidth: {} bytes in {} cycles, {:.3f} bytes/cycle",
+                stats.bytes, cycles,
+                cycles == 0 ? 0.0 : static_cast<double>(stats.bytes) / cycles);
+  console->info("DRAM rows: {:.2f}% hit, {:.2f}% empty, {:.2f}% conflict",
+                100.0 * stats.row_hits / accesses,
+                100.0 * stats.row_empty / accesses,
+                100.0 * stats.row_conflicts / accesses);
+  console->info(
+      "DRAM latency: read avg {:.2f}, write avg {:.2f} cycles",
+      stats.reads == 0 ? 0.0
+                       : static_cast<double>(stats.read_latency_sum) /
+                             stats.reads,
+      stats.writes == 0 ? 0.0
+                        : static_cast<double>(stats.write_latency_sum) /
+                              stats.writes);
+  for (size_t i = 0; i < DramStats::hist_buckets; i++) {
+    if (stats.read_hist[i] == 0 && stats.write_hist[i] == 0) {
+      continue;
+    }
+    const uint64_t low = i == 0 ? 0 : 1ULL << (i - 1);
+    console->info("  [{:>5}, {:>5}) read {:>10} write {:>10}", low,
+                  i + 1 == DramStats::hist_buckets ? "inf"
+                                                   : std::to_string(1ULL << i),
+                  stats.read_hist[i], stats.write_hist[i]);
+  }
+}
+} // namespace SimDevices
@@ -0,0 +1,223 @@
+#include "include/ImageCache.h"
+#include "elfio/elfio.hpp"
+#include "spdlog/spdlog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SimDevices {
+
+static constexpr uint64_t image_page = 4096;
+
+// FNV-1a over 8-byte words of an mmap of the file, the tail is zero padded
+static std::optional<uint64_t> hash_file(const std::string &file_name) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return std::nullopt;
+  }
+  const auto size = static_cast<size_t>(st.st_size);
+  uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+  if (size == 0) {
+    close(fd);
+    return hash;
+  }
+  auto *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  size_t pos = 0;
+  for (; pos + 8 <= size; pos += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + pos, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  if (pos < size) {
+    uint64_t word = 0;
+    std::memcpy(&word, bytes + pos, size - pos);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  munmap(data, size);
+  return hash;
+}
+
+// changes whenever the file is rewritten, without reading it
+static std::optional<std::string> stat_key(const std::string &file_name) {
+  struct stat st{};
+  if (stat(file_name.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+  return std::format("{:x}_{:x}_{:x}_{:x}.{:09}", st.st_dev, st.st_ino,
+                     st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+}
+
+static bool is_elf(const std::string &file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  char magic[4] = {};
+  file.read(magic, sizeof(magic));
+  return file.gcount() == 4 && magic[0] == 0x7f && magic[1] == 'E' &&
+         magic[2] == 'L' && magic[3] == 'F';
+}
+
+ImageCache::ImageCache(std::filesystem::path cache_dir)
+    : cache_dir(std::move(cache_dir)) {
+  std::filesystem::create_directories(this->cache_dir);
+}
+
+bool ImageCache::build(const std::string &file_name, const uint64_t mem_addr,
+                       const uint64_t mem_size,
+                       const std::filesystem::path &img_path,
+                       const std::filesystem::path &sym_path) const {
+  using namespace ELFIO;
+  const auto console = spdlog::get("console");
+
+  auto reader = elfio();
+  if (!reader.load(file_name) || reader.get_class() != ELFCLASS64 ||
+      reader.get_machine() != EM_RISCV) {
+    return false;
+  }
+
+  const auto suffix = std::format(".tmp.{}", getpid());
+  const auto img_tmp = img_path.string() + suffix;
+  const auto sym_tmp = sym_path.string() + suffix;
+
+  const int fd = open(img_tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  uint64_t image_end = 0;
+  bool ok = true;
+  for (const auto &pseg : reader.segments) {
+    if (pseg->get_type() != PT_LOAD || pseg->get_file_size() == 0) {
+      continue;
+    }
+    const auto offset = pseg->get_physical_address() - mem_addr;
+    if (pseg->get_physical_address() < mem_addr ||
+        offset + pseg->get_memory_size() > mem_size) {
+      console->warn("segment at 0x{:x} is outside of the guest memory",
+                    pseg->get_physical_address());
+      ok = false;
+      break;
+    }
+    // bss stays a hole in the sparse file
+    ok &= pwrite(fd, pseg->get_data(), pseg->get_file_size(),
+                 static_cast<off_t>(offset)) ==
+          static_cast<ssize_t>(pseg->get_file_size());
+    image_end = std::max(image_end, offset + pseg->get_memory_size());
+  }
+  const auto image_size = (image_end + image_page - 1) & ~(image_page - 1);
+  ok &= ftruncate(fd, static_cast<off_t>(image_size)) == 0;
+  close(fd);
+
+  std::ofstream sym_file(sym_tmp, std::ios::trunc);
+  for (const auto &psec : reader.sections) {
+    if (psec->get_type() != SHT_SYMTAB) {
+      continue;
+    }
+    const symbol_section_accessor symbols(reader, psec.get());
+    for (unsigned int j = 0; j < symbols.get_symbols_num(); ++j) {
+      std::string name;
+      Elf64_Addr value;
+      Elf_Xword size;
+      unsigned char bind;
+      unsigned char type;
+      Elf_Half section_index;
+      unsigned char other;
+      symbols.get_symbol(j, name, value, size, bind, type, section_index,
+                         other);
+      if (!name.empty()) {
+        sym_file << name << ' ' << value << '\n';
+      }
+    }
+  }
+  sym_file.close();
+  ok &= !sym_file.fail();
+
+  if (!ok) {
+    std::filesystem::remove(img_tmp);
+    std::filesystem::remove(sym_tmp);
+    return false;
+  }
+  // the image first, a present .sym means the .img is complete
+  std::filesystem::rename(img_tmp, img_path);
+  std::filesystem::rename(sym_tmp, sym_path);
+  console->info("Image cache: converted {} to {}", file_name,
+                img_path.string());
+  return true;
+}
+
+std::optional<uint64_t>
+ImageCache::content_hash(const std::string &file_name) const {
+  const auto file_key = stat_key(file_name);
+  if (!file_key.has_value()) {
+    return std::nullopt;
+  }
+  const auto ref_path = cache_dir / (file_key.value() + ".ref");
+
+  uint64_t hash;
+  if (std::ifstream ref_file(ref_path);
+      ref_file >> std::hex >> hash) [[likely]] {
+    return hash;
+  }
+
+  const auto file_hash = hash_file(file_name);
+  if (!file_hash.has_value()) {
+    return std::nullopt;
+  }
+  const auto ref_tmp = ref_path.string() + std::format(".tmp.{}", getpid());
+  std::ofstream(ref_tmp, std::ios::trunc)
+      << std::format("{:016x}\n", file_hash.value());
+  std::filesystem::rename(ref_tmp, ref_path);
+  return file_hash;
+}
+
+std::optional<ImageCache::Image> ImageCache::get(const std::string &file_name,
+                                                 const uint64_t mem_addr,
+                                                 const uint64_t mem_size) const {
+  if (!is_elf(file_name)) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(file_name, ec);
+    if (ec || size > mem_size) {
+      return std::nullopt;
+    }
+    return Image{.path = file_name, .size = size, .symbols = {}};
+  }
+
+  const auto hash = content_hash(file_name);
+  if (!hash.has_value()) {
+    return std::nullopt;
+  }
+  const auto key =
+      std::format("{:016x}_{:x}_{:x}", hash.value(), mem_addr, mem_size);
+  const auto img_path = cache_dir / (key + ".img");
+  const auto sym_path = cache_dir / (key + ".sym");
+
+  if (!std::filesystem::exists(sym_path) &&
+      !build(file_name, mem_addr, mem_size, img_path, sym_path)) {
+    return std::nullopt;
+  }
+
+  Image image{.path = img_path.string(),
+              .size = std::filesystem::file_size(img_path),
+              .symbols = {}};
+  std::ifstream sym_file(sym_path);
+  std::string name;
+  uint64_t value;
+  while (sym_file >> name >> value) {
+    image.symbols[name] = value;
+  }
+  return image;
+}
+} // namespace SimDevices
@@ -0,0 +1,99 @@
+#include "include/L2Cache.h"
+#include "include/Utils.h"
+#include <algorithm>
+#include <bit>
+#include <span>
+
+namespace SimDevices {
+
+L2Cache::L2Cache(const L2Config &config, DramModel *dram)
+    : config(config), dram(dram) {
+  MY_ASSERT(config.ways > 0 && std::has_single_bit(config.line_bytes) &&
+                config.line_bytes >= 8,
+            "l2 line size must be a power of two of at least 8 bytes\n");
+  MY_ASSERT(config.size % (static_cast<uint64_t>(config.ways) *
+                           config.line_bytes) ==
+                    0 &&
+                std::has_single_bit(config.size /
+                                    (config.ways * config.line_bytes)),
+            "l2 size / (ways * line size) must be a power of two\n");
+  const uint64_t sets = config.size / (config.ways * config.line_bytes);
+  line_shift = std::countr_zero(config.line_bytes);
+  set_shift = std::countr_zero(sets);
+  set_mask = sets - 1;
+  line_beats = config.line_bytes / 8;
+  lines.resize(sets * config.ways);
+}
+
+L2Cache::Line &L2Cache::victim(const size_t set) {
+  const auto ways = std::span(&lines[set * config.ways], config.ways);
+  if (const auto free = std::ranges::find(ways, false, &Line::valid);
+      free != ways.end()) {
+    return *free;
+  }
+  if (config.replacement == L2Replacement::random) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return ways[rng % config.ways];
+  }
+  return *std::ranges::min_element(ways, {}, &Line::stamp);
+}
+
+uint32_t L2Cache::access_line(const uint64_t now, const uint64_t line_idx,
+                              const bool is_write, const bool full_line) {
+  const size_t set = line_idx & set_mask;
+  const uint64_t tag = line_idx >> set_shift;
+  accesses++;
+  clock++;
+
+  for (auto &line : std::span(&lines[set * config.ways], config.ways)) {
+    if (line.valid && line.tag == tag) {
+      hits++;
+      line.dirty |= is_write;
+      if (config.replacement == L2Replacement::lru) {
+        line.stamp = clock;
+      }
+      return config.hit_latency;
+    }
+  }
+
+  misses++;
+  auto &line = victim(set);
+  // the lookup comes first, the fill and the write back follow it
+  const uint64_t issue = now + config.hit_latency;
+  uint32_t latency = config.hit_latency;
+  if (!full_line) {
+    latency += dram == nullptr
+                   ? config.miss_penalty
+                   : dram->access(issue, line_idx << line_shift, line_beats,
+                                  false);
+  }
+  if (line.valid && line.dirty) {
+    writebacks++;
+    // sits in a write back buffer, only the DRAM sees it
+    if (dram != nullptr) {
+      const uint64_t victim_idx = line.tag << set_shift | set;
+      dram->access(issue, victim_idx << line_shift, line_beats, true);
+    }
+  }
+  line = {.tag = tag, .valid = true, .dirty = is_write, .stamp = clock};
+  return latency;
+}
+
+uint32_t L2Cache::access(const uint64_t now, const uint64_t addr,
+                         const uint32_t beats, const bool is_write) {
+  const uint64_t end = addr + beats * 8;
+  const uint64_t first = addr >> line_shift;
+  const uint64_t last = (end - 1) >> line_shift;
+
+  // a burst spanning several lines is ready when its slowest line is
+  uint32_t latency = 0;
+  for (uint64_t line_idx = first; line_idx <= last; line_idx++) {
+    const bool full_line = is_write && addr <= line_idx << line_shift &&
+                           end >= (line_idx + 1) << line_shift;
+    latency = std::max(latency, access_line(now, line_idx, is_write, full_line));
+  }
+  return latency;
+}
+} // namespace SimDevices
@@ -0,0 +1,149 @@
+#include "include/MemTrace.h"
+#include "include/Utils.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SimDevices {
+
+static constexpr char trace_magic[8] = {'F', 'S', 'M', 'T', 'R', 'C', '0', '1'};
+static constexpr size_t flush_size = 1 << 20;
+// tag, two 10-byte varints, 8 strobe bytes, 8 data words
+static constexpr size_t max_record_size =
+    1 + 10 + 10 + MemTraceRecord::max_beats * 9;
+
+static uint64_t zigzag(const uint64_t delta) {
+  return (delta << 1) ^ (static_cast<int64_t>(delta) >> 63);
+}
+
+static uint64_t unzigzag(const uint64_t value) {
+  return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+MemTraceWriter::MemTraceWriter(const std::string &path, const uint64_t *cycle)
+    : file(path, std::ios::binary | std::ios::trunc), cycle(cycle) {
+  MY_ASSERT(file.is_open(), "can not open mem trace %s\n", path.c_str());
+  buf.reserve(flush_size + max_record_size);
+  buf.insert(buf.end(), std::begin(trace_magic), std::end(trace_magic));
+}
+
+MemTraceWriter::~MemTraceWriter() { close(); }
+
+void MemTraceWriter::put_varint(uint64_t value) {
+  while (value >= 0x80) {
+    buf.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  buf.push_back(static_cast<uint8_t>(value));
+}
+
+void MemTraceWriter::record(const uint64_t cycle, const MemTraceOp op,
+                            const uint64_t addr, const uint8_t beats,
+                            const uint64_t strb, const uint64_t *data) {
+  DEBUG_ASSERT(beats > 0 && beats <= MemTraceRecord::max_beats,
+               "bad trace burst length %d\n", beats);
+  const auto tag = static_cast<uint8_t>(op) | (beats - 1) << 2;
+  buf.push_back(static_cast<uint8_t>(tag));
+  put_varint(zigzag(cycle - prev_cycle));
+  put_varint(zigzag(addr - prev_addr));
+  prev_cycle = cycle;
+  prev_addr = addr;
+  if (op == MemTraceOp::write || op == MemTraceOp::burst_write) {
+    for (size_t i = 0; i < beats; i++) {
+      buf.push_back(static_cast<uint8_t>(strb >> (i * 8)));
+    }
+  }
+  const auto data_bytes = reinterpret_cast<const uint8_t *>(data);
+  buf.insert(buf.end(), data_bytes, data_bytes + beats * sizeof(uint64_t));
+  records++;
+
+  if (buf.size() >= flush_size) [[unlikely]] {
+    flush();
+  }
+}
+
+void MemTraceWriter::flush() {
+  file.write(reinterpret_cast<const char *>(buf.data()),
+             static_cast<std::streamsize>(buf.size()));
+  bytes += buf.size();
+  buf.clear();
+}
+
+void MemTraceWriter::close() {
+  if (!file.is_open()) {
+    return;
+  }
+  flush();
+  file.close();
+}
+
+MemTraceReader::MemTraceReader(const std::string &path)
+    : file(path, std::ios::binary) {
+  buf.resize(flush_size);
+  char magic[sizeof(trace_magic)] = {};
+  file.read(magic, sizeof(magic));
+  valid = file.gcount() == sizeof(magic) &&
+          std::memcmp(magic, trace_magic, sizeof(magic)) == 0;
+}
+
+void MemTraceReader::refill() {
+  if (end - pos >= max_record_size || !file) {
+    return;
+  }
+  std::copy(buf.begin() + pos, buf.begin() + end, buf.begin());
+  end -= pos;
+  pos = 0;
+  file.read(reinterpret_cast<char *>(buf.data() + end),
+            static_cast<std::streamsize>(buf.size() - end));
+  end += file.gcount();
+}
+
+bool MemTraceReader::get_varint(uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 64 && pos < end; shift += 7) {
+    const uint8_t byte = buf[pos++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MemTraceReader::next(MemTraceRecord &record) {
+  if (!valid) {
+    return false;
+  }
+  refill();
+  if (pos == end) {
+    return false;
+  }
+
+  const uint8_t tag = buf[pos++];
+  record.op = static_cast<MemTraceOp>(tag & 0x3);
+  record.beats = (tag >> 2 & 0x7) + 1;
+  uint64_t cycle_delta = 0;
+  uint64_t addr_delta = 0;
+  if (!get_varint(cycle_delta) || !get_varint(addr_delta)) {
+    truncated = true;
+    return false;
+  }
+  record.cycle = prev_cycle + unzigzag(cycle_delta);
+  record.addr = prev_addr + unzigzag(addr_delta);
+  prev_cycle = record.cycle;
+  prev_addr = record.addr;
+
+  const size_t strb_bytes = record.is_write() ? record.beats : 0;
+  const size_t data_bytes = record.beats * sizeof(uint64_t);
+  if (end - pos < strb_bytes + data_bytes) {
+    truncated = true;
+    return false;
+  }
+  record.strb = 0;
+  for (size_t i = 0; i < strb_bytes; i++) {
+    record.strb |= static_cast<uint64_t>(buf[pos++]) << (i * 8);
+  }
+  std::memcpy(record.data.data(), &buf[pos], data_bytes);
+  pos += data_bytes;
+  return true;
+}
+} // namespace SimDevices
@@ -15,15 +15,28 @@ void PerfMonitor::add_perf_counter(CounterInfo perf_counter) {
 }
 
 void PerfMonitor::print_perf_counter(const bool use_log) const {
-  const auto log_select = use_log ? logger : perf_trace;
+  print_perf_snapshot(snapshot(), use_log);
+}
 
+PerfMonitor::Snapshot PerfMonitor::snapshot() const {
+  Snapshot snap;
+  snap.reserve(perf_counters.size());
   for (const auto &counter : perf_counters) {
-    const auto hit = *counter.hit;
-    const auto total = *counter.total;
+    snap.emplace_back(*counter.hit, *counter.total);
+  }
+  return snap;
+}
+
+void PerfMonitor::print_perf_snapshot(const Snapshot &snap,
+                                      const bool use_log) const {
+  const auto log_select = use_log ? logger : perf_trace;
+
+  for (size_t idx = 0; idx < snap.size(); idx++) {
+    const auto [hit, total] = snap[idx];
 
     const auto hit_rate = static_cast<double>(hit) / total;
     log_select->info("{:<10} hit_count:{:<8} total_count:{:<8} hit_rate:{:<10}",
-                     counter.name.c_str(), hit, total, hit_rate);
+                     perf_counters[idx].name.c_str(), hit, total, hit_rate);
   }
   log_select->info("");
 }
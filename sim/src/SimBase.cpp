@@ -4,15 +4,13 @@
 #include "Utils.h"
 #include "Vtop.h"
 #include "spdlog/spdlog.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <memory>
 #include <optional>
 
-#include "async_simple/coro/Lazy.h"
-#include "async_simple/coro/SyncAwait.h"
 #include "async_simple/executors/SimpleExecutor.h"
-using namespace async_simple;
-using namespace async_simple::coro;
 
 #if VM_TRACE_FST == 1
 
@@ -20,7 +18,29 @@ using namespace async_simple::coro;
 
 #endif
 
-SimBase::SimBase() { top = std::make_shared<Vtop>(); }
+SimBase::SimBase() {
+  top = std::make_shared<Vtop>();
+  commit_record.sim = this;
+  init_arch_state_ports();
+}
+
+void SimBase::init_arch_state_ports() {
+  inst_info_ports = VtopBindings::inst_info_ports(top.get());
+  gpr_ports = VtopBindings::gpr_ports(top.get());
+  all_csr_ports = VtopBindings::csr_ports(top.get());
+
+  for (size_t idx = 0; idx < diff_csr_addrs.size(); idx++) {
+    csr_ports[idx] = csr_port(diff_csr_addrs[idx]);
+  }
+}
+
+uint64_t CommitRecord::gpr(const size_t idx) const {
+  return sim->get_reg(static_cast<int>(idx));
+}
+
+uint64_t CommitRecord::csr(const size_t addr) const {
+  return sim->get_csr(static_cast<int>(addr));
+}
 
 void SimBase::dump_wave() const {
 #if VM_TRACE_FST == 1
@@ -45,7 +65,18 @@ void SimBase::enable_wave_trace(const std::string &file_name,
 #endif
 }
 
-void SimBase::enable_corotinue() { enable_corotinue_task = true; }
+void SimBase::enable_corotinue(const size_t threads) {
+  async_executor =
+      std::make_unique<async_simple::executors::SimpleExecutor>(threads);
+  spdlog::get("console")->info("Async tasks run on {} worker threads",
+                               threads);
+}
+
+void SimBase::drain_async_tasks() const {
+  for (const auto &drain : async_drain_funcs) {
+    drain();
+  }
+}
 
 SimBase::~SimBase() {
 #if VM_TRACE_FST == 1
@@ -86,14 +117,9 @@ void SimBase::reset() {
 void SimBase::prepare() {
 
   if (wave_trace_flag) {
-    SimTask_t wave_task = {.task_func = [&] { dump_wave(); },
-                           .name = "dump_wave",
-                           .period_cycle = 0,
-                           .type = SimTaskType::period};
-    wave_task.name = "dump_wave_after_clk_rise";
-    add_after_clk_rise_task(wave_task);
-    wave_task.name = "before_clk_rise";
-    add_before_clk_rise_task(wave_task);
+    add_after_clk_rise_task("dump_wave_after_clk_rise",
+                            [this] { dump_wave(); });
+    add_before_clk_rise_task("before_clk_rise", [this] { dump_wave(); });
   };
   print_tasks();
   reset();
@@ -108,168 +134,110 @@ bool SimBase::exit_normal() const {
 
 uint64_t SimBase::get_pc() const { return top->io_difftest_bits_last_pc; }
 
-uint64_t SimBase::get_reg(const int idx) {
-#define GET_REG(top, idx) (top->io_difftest_bits_gpr_##idx)
-
-  switch (idx) {
-  case 0:
-    return GET_REG(top, 0);
-  case 1:
-    return GET_REG(top, 1);
-  case 2:
-    return GET_REG(top, 2);
-  case 3:
-    return GET_REG(top, 3);
-  case 4:
-    return GET_REG(top, 4);
-  case 5:
-    return GET_REG(top, 5);
-  case 6:
-    return GET_REG(top, 6);
-  case 7:
-    return GET_REG(top, 7);
-  case 8:
-    return GET_REG(top, 8);
-  case 9:
-    return GET_REG(top, 9);
-  case 10:
-    return GET_REG(top, 10);
-  case 11:
-    return GET_REG(top, 11);
-  case 12:
-    return GET_REG(top, 12);
-  case 13:
-    return GET_REG(top, 13);
-  case 14:
-    return GET_REG(top, 14);
-  case 15:
-    return GET_REG(top, 15);
-  case 16:
-    return GET_REG(top, 16);
-  case 17:
-    return GET_REG(top, 17);
-  case 18:
-    return GET_REG(top, 18);
-  case 19:
-    return GET_REG(top, 19);
-  case 20:
-    return GET_REG(top, 20);
-  case 21:
-    return GET_REG(top, 21);
-  case 22:
-    return GET_REG(top, 22);
-  case 23:
-    return GET_REG(top, 23);
-  case 24:
-    return GET_REG(top, 24);
-  case 25:
-    return GET_REG(top, 25);
-  case 26:
-    return GET_REG(top, 26);
-  case 27:
-    return GET_REG(top, 27);
-  case 28:
-    return GET_REG(top, 28);
-  case 29:
-    return GET_REG(top, 29);
-  case 30:
-    return GET_REG(top, 30);
-  case 31:
-    return GET_REG(top, 31);
-  default:
-    MY_ASSERT(false, "get_reg failed, index[%d] out of range", idx);
-    return 0;
+uint64_t SimBase::get_reg(const int idx) const {
+  MY_ASSERT(idx >= 0 && idx < 32, "get_reg failed, index[%d] out of range",
+            idx);
+  return *gpr_ports[idx];
+}
+
+const uint64_t *SimBase::csr_port(const int addr) const {
+  MY_ASSERT(addr < 4096, "csr index out of range");
+  for (const auto &[port_addr, port] : all_csr_ports) {
+    if (port_addr == addr) {
+      return port;
+    }
   }
+  MY_ASSERT(false, "csr 0x%x has no difftest port", addr);
+  return nullptr;
 }
 
-uint64_t SimBase::get_csr(int idx) {
-  MY_ASSERT(idx < 4096, "csr index out of range");
-#define GET_CSR(top, name) (top->io_difftest_bits_csr_##name)
-  switch (idx) {
-  case MISA:
-    return GET_CSR(top, misa);
-  case MSTATUS:
-    return GET_CSR(top, mstatus);
-  case MIE:
-    return GET_CSR(top, mie);
-  case MTVEC:
-    return GET_CSR(top, mtvec);
-  case MEPC:
-    return GET_CSR(top, mepc);
-  case MCAUSE:
-    return GET_CSR(top, mcause);
-  case MTVAL:
-    return GET_CSR(top, mtval);
-  case MEDELEG:
-    return GET_CSR(top, medeleg);
-  case MIDELEG:
-    return GET_CSR(top, mideleg);
-  case MSCRATCH:
-    return GET_CSR(top, mscratch);
-  case SSTATUS:
-    return GET_CSR(top, mstatus);
-  case SEPC:
-    return GET_CSR(top, sepc);
-  case SCAUSE:
-    return GET_CSR(top, scause);
-  case STVAL:
-    return GET_CSR(top, stval);
-  case STVEC:
-    return GET_CSR(top, stvec);
-  case SATP:
-    return GET_CSR(top, satp);
-  case SSCRATCH:
-    return GET_CSR(top, sscratch);
+uint64_t SimBase::get_csr(const int idx) const { return *csr_port(idx); }
 
-  default:
-    MY_ASSERT(false, "csr index out of range");
-    return 0;
+void SimBase::read_arch_state(ArchState &state) const {
+  state.pc = top->io_difftest_bits_last_pc;
+  for (size_t idx = 0; idx < gpr_ports.size(); idx++) {
+    state.gpr[idx] = *gpr_ports[idx];
+  }
+  for (size_t idx = 0; idx < csr_ports.size(); idx++) {
+    state.csr[idx] = *csr_ports[idx];
   }
 }
 
 bool SimBase::finished() const { return sim_state != sim_run; }
 
 void SimBase::add_after_clk_rise_task(const SimTask_t &task) {
-  after_clk_rise_tasks.emplace_back(task);
+  after_clk_rise_tasks.add_task(task, cycle_num);
 }
 
 void SimBase::add_before_clk_rise_task(const SimTask_t &task) {
-  before_clk_rise_tasks.emplace_back(task);
+  before_clk_rise_tasks.add_task(task, cycle_num);
 }
 
 void SimBase::add_once_time_task(const SimTask_t &task) {
   once_time_tasks.emplace_back(task);
 }
 
+void SimBase::add_run_end_task(const SimTask_t &task) {
+  run_end_tasks.emplace_back(task);
+}
+
+void SimBase::add_commit_listener(const CommitListener_t &listener) {
+  commit_listeners.emplace_back(listener);
+}
+
 void SimBase::print_tasks() const {
   auto console = spdlog::get("console");
 
-  console->info("Before Clk Rise Tasks: {}", before_clk_rise_tasks.size());
-  for (const auto &task : before_clk_rise_tasks) {
+  console->info("Before Clk Rise Tasks: {}",
+                before_clk_rise_tasks.get_tasks().size());
+  for (const auto &task : before_clk_rise_tasks.get_tasks()) {
     console->info("Task Name: {:20}, Period: {}", task.name, task.period_cycle);
   }
 
-  console->info("After Clk Rise Tasks: {}", after_clk_rise_tasks.size());
-  for (const auto &task : after_clk_rise_tasks) {
+  console->info("After Clk Rise Tasks: {}",
+                after_clk_rise_tasks.get_tasks().size());
+  for (const auto &task : after_clk_rise_tasks.get_tasks()) {
     console->info("Task Name: {:20} Period: {}", task.name, task.period_cycle);
   }
+
+  console->info("Commit Listeners: {}", commit_listeners.size());
+  for (const auto &listener : commit_listeners) {
+    console->info("Listener Name: {:20}", listener.name);
+  }
+
+  console->info("Run End Tasks: {}", run_end_tasks.size());
+  for (const auto &task : run_end_tasks) {
+    console->info("Task Name: {:20}", task.name);
+  }
 }
 
-void SimBase::step() {
+void SimBase::decode_commit() {
+  auto &rec = commit_record;
+  rec.cycle = cycle_num;
+  rec.commit_num = top->io_difftest_bits_commited_num;
+  for (size_t idx = 0; idx < inst_info_ports.size(); idx++) {
+    const auto &ports = inst_info_ports[idx];
+    rec.inst_info[idx] = {*ports.pc, *ports.inst, *ports.is_rvc != 0};
+  }
 
-  static auto execute_tasks_co =
-      [&](std::vector<SimTask_t> &tasks) -> Lazy<void> {
-    for (auto &task : tasks) {
-      co_await task.run_co();
-    }
-    co_return;
-  };
-  static auto execute_tasks_sync = [&](auto &tasks) {
-    for (auto &task : tasks) {
-      task.run_sync();
-    }
-  };
+  rec.pc = top->io_difftest_bits_last_pc;
+  rec.is_rvc = top->io_difftest_bits_last_is_rvc;
+  rec.inst = rec.commit_num > 0 ? rec.inst_info[rec.commit_num - 1].inst
+                                : rec.inst_info[0].inst;
+
+  rec.has_exception = top->io_difftest_bits_exception_valid;
+  rec.has_interrupt = top->io_difftest_bits_has_interrupt;
+  rec.cause = top->io_difftest_bits_exception_cause;
+  rec.tval = top->io_difftest_bits_exception_tval;
+  rec.has_mmio = top->io_difftest_bits_contain_mmio;
+  rec.csr_skip = top->io_difftest_bits_csr_skip;
+  rec.store = {.valid = top->io_difftest_bits_store_valid != 0,
+               .paddr = top->io_difftest_bits_store_bits_paddr,
+               .wdata = top->io_difftest_bits_store_bits_wdata,
+               .wstrb = top->io_difftest_bits_store_bits_wstrb};
+}
 
+void SimBase::step() {
   top->clock ^= 1;
   top->eval();
   // always sample on posedge
@@ -279,21 +247,109 @@ void SimBase::step() {
     if (top->io_difftest_valid) {
       commit_num += top->io_difftest_bits_commited_num;
       not_commit_num = 0;
-    }
 
-    // execute after step tasks
-    if (enable_corotinue_task) {
-      syncAwait(execute_tasks_co(after_clk_rise_tasks));
-    } else {
-      execute_tasks_sync(after_clk_rise_tasks);
+      if (!commit_listeners.empty()) {
+        decode_commit();
+        for (const auto &listener : commit_listeners) {
+          listener.listener_func(commit_record);
+        }
+      }
     }
 
+    // execute after step tasks
+    after_clk_rise_tasks.run(cycle_num);
   } else {
     // execute before step tasks
-    if (enable_corotinue_task) {
-      syncAwait(execute_tasks_co(before_clk_rise_tasks));
-    } else {
-      execute_tasks_sync(before_clk_rise_tasks);
+    before_clk_rise_tasks.run(cycle_num);
+  }
+}
+
+void SimBase::step_cycle() {
+  step();
+  step();
+}
+
+SimBase::StopReason SimBase::stop_reason_from_state() const {
+  return sim_state == sim_finish ? stop_finish : stop_abort;
+}
+
+/**
+ * @brief Run up to n_cycles full clock cycles. Tasks end the run by calling
+ * set_state(), which is checked once per cycle; the stop predicate is only
+ * evaluated every predicate_check_interval cycles.
+ * @return why the run stopped
+ */
+SimBase::StopReason SimBase::run(const uint64_t n_cycles,
+                                 const StopPredicate &stop_predicate) {
+  const auto console = spdlog::get("console");
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto start_cycle = cycle_num;
+  const auto start_commit = commit_num;
+  const auto end_cycle = n_cycles > UINT64_MAX - cycle_num
+                             ? UINT64_MAX
+                             : cycle_num + n_cycles;
+
+  StopReason reason;
+  while (true) {
+    const auto chunk_end =
+        std::min(end_cycle, cycle_num + predicate_check_interval);
+    while (cycle_num < chunk_end && sim_state == sim_run) {
+      step_cycle();
     }
+
+    if (sim_state != sim_run) {
+      reason = stop_reason_from_state();
+      break;
+    }
+    if (cycle_num >= end_cycle) {
+      reason = stop_max_cycles;
+      break;
+    }
+    if (stop_predicate && stop_predicate()) {
+      reason = stop_user;
+      break;
+    }
+  }
+
+  for (const auto &task : run_end_tasks) {
+    task.task_func();
+  }
+  if (sim_state != sim_run && reason != stop_reason_from_state()) {
+    // a run end task found an error the sim thread has not seen yet
+    reason = stop_reason_from_state();
+  }
+
+  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  // let the workers finish printing before the summary
+  drain_async_tasks();
+  const auto cycles = cycle_num - start_cycle;
+  const auto insts = commit_num - start_commit;
+  const auto ms = static_cast<double>(duration.count() + 1);
+
+  console->info("Simulator stop ({}), Simulate {} cycles {} insts in {} ms, "
+                "Speed {:.2f} KIPS, {:.2f} K cycles/second",
+                stop_reason_str(reason), cycles, insts, duration.count(),
+                static_cast<double>(insts) / ms,
+                static_cast<double>(cycles) / ms);
+  return reason;
+}
+
+SimBase::StopReason SimBase::run_until(const StopPredicate &stop_predicate) {
+  return run(UINT64_MAX, stop_predicate);
+}
+
+std::string_view SimBase::stop_reason_str(const StopReason reason) {
+  switch (reason) {
+  case stop_finish:
+    return "finish";
+  case stop_abort:
+    return "abort";
+  case stop_max_cycles:
+    return "max cycles";
+  case stop_user:
+    return "stop predicate";
+  default:
+    return "unknown";
   }
 }
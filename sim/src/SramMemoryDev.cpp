@@ -6,39 +6,79 @@
 #include "include/Utils.h"
 #include "spdlog/logger.h"
 #include "spdlog/spdlog.h"
+#include <algorithm>
 #include <bit>
 #include <cstdint>
+#include <cstring>
 #include <format>
 #include <functional>
 #include <iostream>
 #include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 static std::shared_ptr<spdlog::logger> console = nullptr;
 
 namespace SimDevices {
-SynReadMemoryDev::SynReadMemoryDev(uint64_t base_addr, uint32_t mem_size) {
+SynReadMemoryDev::SynReadMemoryDev(uint64_t base_addr, uint64_t mem_size) {
   this->mem_addr = base_addr;
   this->mem_size = mem_size;
-  mem = std::vector<uint8_t>(mem_size);
-  MY_ASSERT(mem.size() == mem_size, "memory size not match");
+
+  // reserve address space only, the kernel hands out zero pages on first
+  // touch, so a small test only costs the pages it uses
+  void *addr = mmap(nullptr, mem_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  MY_ASSERT(addr != MAP_FAILED, "mmap guest memory failed, size: 0x%lx",
+            mem_size);
+  mem = static_cast<uint8_t *>(addr);
+  // fewer TLB misses for large guests, best effort
+  madvise(mem, mem_size, MADV_HUGEPAGE);
 
   console = spdlog::get("console");
 }
 
+SynReadMemoryDev::~SynReadMemoryDev() {
+  if (mem != nullptr) {
+    munmap(mem, mem_size);
+  }
+}
+
+uint64_t SynReadMemoryDev::touched_bytes() const {
+  const auto host_page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> resident((mem_size + host_page - 1) / host_page);
+  if (mincore(mem, mem_size, resident.data()) != 0) {
+    return 0;
+  }
+  uint64_t touched = 0;
+  for (const auto page : resident) {
+    touched += page & 1;
+  }
+  return touched * host_page;
+}
+
+void SynReadMemoryDev::print_mem_stats() const {
+  console->info("Memory: {} MiB reserved, {} KiB touched", mem_size >> 20,
+                touched_bytes() >> 10);
+}
+
 uint64_t SynReadMemoryDev::read(uint64_t addr) {
   //        if (in_range(addr)) {
   //            return 0;
   //        }
-  MY_ASSERT(in_range(addr), "read address out of range");
-  MY_ASSERT(Utils::check_aligned(addr, 8), "read address not aligned");
+  DEBUG_ASSERT(in_range(addr), "read address out of range");
+  DEBUG_ASSERT(Utils::check_aligned(addr, 8), "read address not aligned");
   uint64_t result = 0;
   std::memcpy(&result, &mem[addr - mem_addr], sizeof(uint64_t));
   return result;
 }
 
 void SynReadMemoryDev::write(uint64_t addr, uint64_t wdata, uint8_t wstrb) {
-  MY_ASSERT(in_range(addr), "write address out of range");
-  MY_ASSERT(Utils::check_aligned(addr, 8), "write address not aligned");
+  DEBUG_ASSERT(in_range(addr), "write address out of range");
+  DEBUG_ASSERT(Utils::check_aligned(addr, 8), "write address not aligned");
+  if (page_hash_en) [[unlikely]] {
+    update_page_hash(addr, wdata, wstrb);
+  }
   auto wdata_seq = std::bit_cast<std::array<uint8_t, 8>>(wdata);
 
   for (int i = 0; i < 8; i++) {
@@ -51,10 +91,10 @@ void SynReadMemoryDev::write(uint64_t addr, uint64_t wdata, uint8_t wstrb) {
 void SynReadMemoryDev::update_inputs(uint64_t read_addr, bool read_en,
                                      WriteReq write_req, bool write_en) {
   if (read_en) {
-    read_req_seq.emplace_back(read_addr);
+    read_slot.put(read_addr);
   }
   if (write_en) {
-    write_req_seq.emplace_back(write_req);
+    write_slot.put(write_req);
   }
 
   if (read_en && write_en) {
@@ -63,27 +103,140 @@ void SynReadMemoryDev::update_inputs(uint64_t read_addr, bool read_en,
   }
 }
 
+void SynReadMemoryDev::port_write(const uint64_t addr, const uint64_t wdata,
+                                  const uint8_t wstrb) {
+  write(addr, wdata, wstrb);
+  if (!write_watches.empty()) [[unlikely]] {
+    fire_write_watches(addr, wstrb);
+  }
+}
+
+// bursts come straight from the DPI port, they are checked in release builds
+// too: a bad address would otherwise copy past the mapping
+bool SynReadMemoryDev::check_burst(const uint64_t start, const size_t beats) {
+  if (dma_ptr(start, beats * sizeof(uint64_t)) != nullptr) [[likely]] {
+    return true;
+  }
+  if (bad_bursts++ == 0) {
+    console->error("burst of {} beats at 0x{:x} is outside RAM 0x{:x}+0x{:x}, "
+                   "ignored",
+                   beats, start, mem_addr, mem_size);
+  }
+  return false;
+}
+
+void SynReadMemoryDev::read_burst(const uint64_t addr, const size_t beats,
+                                  uint64_t *data) {
+  const auto start = Utils::aligned_addr(addr);
+  if (!check_burst(start, beats)) [[unlikely]] {
+    std::fill_n(data, beats, 0);
+    return;
+  }
+  std::memcpy(data, &mem[start - mem_addr], beats * sizeof(uint64_t));
+}
+
+void SynReadMemoryDev::write_burst(const uint64_t addr, const size_t beats,
+                                   const uint64_t *data, const uint64_t strb) {
+  const auto start = Utils::aligned_addr(addr);
+  if (!check_burst(start, beats)) [[unlikely]] {
+    return;
+  }
+  for (size_t i = 0; i < beats; i++) {
+    const auto wstrb = static_cast<uint8_t>(strb >> (i * 8));
+    if (wstrb != 0) {
+      port_write(start + i * 8, data[i], wstrb);
+    }
+  }
+}
+
 /**
  * @brief First read, then write,if read write the same address, the read will
  * get the old value
  * @return
  */
 uint64_t SynReadMemoryDev::update_outputs() {
-  if (!read_req_seq.empty()) {
-    auto read_addr = read_req_seq.back();
-    read_req_seq.pop_back();
+  if (read_slot.pending()) {
+    auto read_addr = read_slot.take();
 
     last_read = read(Utils::aligned_addr(read_addr));
   }
-  if (!write_req_seq.empty()) {
-    auto write_req = this->write_req_seq.back();
-    this->write_req_seq.pop_back();
-    write(Utils::aligned_addr(write_req.waddr), write_req.wdata,
-          write_req.wstrb);
+  if (write_slot.pending()) {
+    auto write_req = write_slot.take();
+    port_write(Utils::aligned_addr(write_req.waddr), write_req.wdata,
+               write_req.wstrb);
   }
   return last_read;
 }
 
+void SynReadMemoryDev::add_write_watch(const uint64_t start,
+                                       const uint64_t end,
+                                       WriteWatchFunc func) {
+  MY_ASSERT(in_range(start) && end > start, "write watch out of range");
+  write_watches.push_back({.start = start, .end = end, .func = std::move(func)});
+}
+
+void SynReadMemoryDev::fire_write_watches(const uint64_t addr,
+                                          const uint8_t wstrb) const {
+  const auto first = addr + std::countr_zero(static_cast<uint32_t>(wstrb));
+  const auto last = addr + 8 - std::countl_zero(wstrb);
+  for (const auto &watch : write_watches) {
+    if (first < watch.end && last > watch.start) {
+      watch.func(addr, wstrb);
+    }
+  }
+}
+
+uint64_t SynReadMemoryDev::hash_page(const uint64_t page_addr) const {
+  uint64_t hash = 0;
+  for (uint64_t addr = page_addr; addr < page_addr + page_size; addr += 8) {
+    uint64_t value;
+    std::memcpy(&value, &mem[addr - mem_addr], sizeof(uint64_t));
+    hash += Utils::word_hash(addr, value);
+  }
+  return hash;
+}
+
+void SynReadMemoryDev::enable_page_hash() {
+  const auto page_num = (mem_size + page_size - 1) / page_size;
+  page_hash_en = true;
+  page_hash.assign(page_num, 0);
+  page_hash_valid.assign(page_num, 0);
+  page_dirty.assign(page_num, 0);
+}
+
+void SynReadMemoryDev::update_page_hash(const uint64_t addr,
+                                        const uint64_t wdata,
+                                        const uint8_t wstrb) {
+  const auto page_idx = (addr - mem_addr) / page_size;
+  if (!page_hash_valid[page_idx]) {
+    page_hash[page_idx] = hash_page(mem_addr + page_idx * page_size);
+    page_hash_valid[page_idx] = 1;
+  }
+  if (!page_dirty[page_idx]) {
+    page_dirty[page_idx] = 1;
+    dirty_pages.push_back(mem_addr + page_idx * page_size);
+  }
+
+  // called before the write lands, so mem still holds the old word
+  const auto old_value = read(addr);
+  const auto mask = Utils::strb_to_mask(wstrb);
+  const auto new_value = (old_value & ~mask) | (wdata & mask);
+  page_hash[page_idx] +=
+      Utils::word_hash(addr, new_value) - Utils::word_hash(addr, old_value);
+}
+
+uint64_t SynReadMemoryDev::get_page_hash(const uint64_t page_addr) const {
+  const auto page_idx = (page_addr - mem_addr) / page_size;
+  return page_hash_valid[page_idx] ? page_hash[page_idx] : hash_page(page_addr);
+}
+
+void SynReadMemoryDev::clear_dirty_pages() {
+  for (const auto page_addr : dirty_pages) {
+    page_dirty[(page_addr - mem_addr) / page_size] = 0;
+  }
+  dirty_pages.clear();
+}
+
 bool SynReadMemoryDev::load_elf(const char *file_name) {
   using namespace ELFIO;
   // Create elfio reader
@@ -124,7 +277,7 @@ void SynReadMemoryDev::load_elf_to_mem(ELFIO::elfio &reader) {
     if (pseg->get_type() == PT_LOAD) {
       // load segment to memory
       const char *p = pseg->get_data();
-      std::memcpy(&this->mem[pseg->get_physical_address() - 0x80000000], p,
+      std::memcpy(&this->mem[pseg->get_physical_address() - mem_addr], p,
                   pseg->get_file_size());
     }
   }
@@ -152,12 +305,56 @@ void SynReadMemoryDev::collect_elf_symbols(ELFIO::elfio &reader) {
   }
 }
 
+void SynReadMemoryDev::enable_image_cache(const std::string &cache_dir) {
+  image_cache.emplace(cache_dir);
+}
+
+/**
+ * @brief Map the image over the start of guest RAM, copy on write. Processes
+ * running the same image share its page cache pages until they write them.
+ */
+bool SynReadMemoryDev::map_image(const std::string &image_path,
+                                 const uint64_t image_size) {
+  const auto page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const auto map_size = (image_size + page - 1) & ~(page - 1);
+  if (map_size == 0 || map_size > mem_size) {
+    return false;
+  }
+
+  const int fd = open(image_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  void *addr = mmap(mem, map_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_FIXED, fd, 0);
+  close(fd);
+  return addr != MAP_FAILED;
+}
+
+bool SynReadMemoryDev::load_cached_image(const char *file_name) {
+  const auto image = image_cache->get(file_name, mem_addr, mem_size);
+  if (!image.has_value() || !map_image(image->path, image->size)) {
+    return false;
+  }
+
+  elf_symbol_map = image->symbols;
+  if (const auto to_host_find = elf_symbol_map.find("tohost");
+      to_host_find != elf_symbol_map.end()) {
+    to_host_addr = to_host_find->second;
+  }
+  console->info("Loading file {} from image {}", file_name, image->path);
+  return true;
+}
+
 /**
  * @brief load file to memory, if the file is elf, load elf to memory, else load
  * the file to memory
  * @param file_name
  */
 void SynReadMemoryDev::load_file(const char *file_name) {
+  if (image_cache.has_value() && load_cached_image(file_name)) {
+    return;
+  }
   if (!load_elf(file_name)) {
     std::ifstream file(file_name, std::ios::binary);
     if (!file.is_open()) {
@@ -167,7 +364,7 @@ void SynReadMemoryDev::load_file(const char *file_name) {
 
     console->info("Loading file {}", file_name);
 
-    file.read(reinterpret_cast<char *>(mem.data()), mem.size());
+    file.read(reinterpret_cast<char *>(mem), mem_size);
     file.close();
   }
 }
@@ -190,7 +387,7 @@ void SynReadMemoryDev::dump_signature(std::string_view signature_file_name) {
     }
 
     for (auto i = sig_start->second; i < sig_end->second; i += 4) {
-      uint32_t value = *reinterpret_cast<uint32_t *>(&mem[i - 0x80000000]);
+      uint32_t value = *reinterpret_cast<uint32_t *>(&mem[i - mem_addr]);
 
       auto fmt = std::format("{:08x}\n", value);
       signature_file.write(fmt.data(), fmt.size());
@@ -218,10 +415,6 @@ std::optional<uint64_t> SynReadMemoryDev::get_to_host_addr() {
   return to_host_addr;
 }
 
-bool SynReadMemoryDev::in_range(uint64_t addr) {
-  return addr >= mem_addr && addr < mem_addr + mem_size;
-}
-
 std::vector<AddrInfo> SynReadMemoryDev::get_addr_info() {
   return {
       {mem_addr, mem_addr + mem_size, "syn_read_mem"},
@@ -0,0 +1,42 @@
+#include "include/TaskScheduler.h"
+#include <algorithm>
+
+void TaskScheduler::add_task(const SimTask_t &task, const uint64_t now) {
+  if (task.period_cycle <= 1) {
+    add_task(task.name, task.task_func);
+    return;
+  }
+
+  // same phase as the old per-task counter: first run after period_cycle
+  // calls, then every period_cycle cycles
+  period_tasks.emplace_back(task);
+  period_order.push_back(tasks.size());
+  deadlines.push({now + task.period_cycle, period_tasks.size() - 1});
+  next_deadline = deadlines.top().cycle;
+  tasks.emplace_back(task);
+}
+
+void TaskScheduler::run_with_due(const uint64_t cycle) {
+  due.clear();
+  while (!deadlines.empty() && deadlines.top().cycle <= cycle) {
+    const auto [at, idx] = deadlines.top();
+    deadlines.pop();
+    due.push_back(idx);
+    deadlines.push({at + period_tasks[idx].period_cycle, idx});
+  }
+  next_deadline = deadlines.empty() ? never : deadlines.top().cycle;
+  // period task indices follow registration order
+  std::ranges::sort(due);
+
+  auto next_due = due.begin();
+  for (const auto &task : every_cycle_tasks) {
+    for (; next_due != due.end() && period_order[*next_due] < task.order;
+         ++next_due) {
+      period_tasks[*next_due].task_func();
+    }
+    task.call(task.ctx);
+  }
+  for (; next_due != due.end(); ++next_due) {
+    period_tasks[*next_due].task_func();
+  }
+}
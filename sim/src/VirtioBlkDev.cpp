@@ -0,0 +1,548 @@
+#include "include/VirtioBlkDev.h"
+#include "include/Utils.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SimDevices {
+
+// virtio-mmio register offsets, virtio spec 4.2.2
+static constexpr uint64_t reg_magic = 0x000;
+static constexpr uint64_t reg_version = 0x004;
+static constexpr uint64_t reg_device_id = 0x008;
+static constexpr uint64_t reg_vendor_id = 0x00c;
+static constexpr uint64_t reg_device_features = 0x010;
+static constexpr uint64_t reg_device_features_sel = 0x014;
+static constexpr uint64_t reg_driver_features = 0x020;
+static constexpr uint64_t reg_driver_features_sel = 0x024;
+static constexpr uint64_t reg_queue_sel = 0x030;
+static constexpr uint64_t reg_queue_num_max = 0x034;
+static constexpr uint64_t reg_queue_num = 0x038;
+static constexpr uint64_t reg_queue_ready = 0x044;
+static constexpr uint64_t reg_queue_notify = 0x050;
+static constexpr uint64_t reg_interrupt_status = 0x060;
+static constexpr uint64_t reg_interrupt_ack = 0x064;
+static constexpr uint64_t reg_status = 0x070;
+static constexpr uint64_t reg_queue_desc_low = 0x080;
+static constexpr uint64_t reg_queue_desc_high = 0x084;
+static constexpr uint64_t reg_queue_avail_low = 0x090;
+static constexpr uint64_t reg_queue_avail_high = 0x094;
+static constexpr uint64_t reg_queue_used_low = 0x0a0;
+static constexpr uint64_t reg_queue_used_high = 0x0a4;
+static constexpr uint64_t reg_config_generation = 0x0fc;
+static constexpr uint64_t reg_config = 0x100;
+
+// struct virtio_blk_config
+static constexpr uint64_t config_capacity = 0x00;
+static constexpr uint64_t config_seg_max = 0x0c;
+
+static constexpr uint64_t feature_blk_seg_max = 1ULL << 2;
+static constexpr uint64_t feature_blk_ro = 1ULL << 5;
+static constexpr uint64_t feature_blk_flush = 1ULL << 9;
+static constexpr uint64_t feature_version_1 = 1ULL << 32;
+static constexpr uint64_t feature_access_platform = 1ULL << 33;
+
+static constexpr uint32_t status_features_ok = 8;
+
+static constexpr uint16_t desc_f_next = 1;
+static constexpr uint16_t desc_f_write = 2;
+static constexpr uint16_t avail_f_no_interrupt = 1;
+
+static constexpr uint32_t blk_t_in = 0;
+static constexpr uint32_t blk_t_out = 1;
+static constexpr uint32_t blk_t_flush = 4;
+static constexpr uint32_t blk_t_get_id = 8;
+static constexpr uint8_t blk_s_ok = 0;
+static constexpr uint8_t blk_s_ioerr = 1;
+static constexpr uint8_t blk_s_unsupp = 2;
+static constexpr size_t blk_id_bytes = 20;
+
+struct BlkReqHeader {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+};
+
+// guest memory is little-endian like the host, rings are read in place
+template <typename T> static T load(const uint8_t *ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  return value;
+}
+
+template <typename T> static void store(uint8_t *ptr, const T value) {
+  std::memcpy(ptr, &value, sizeof(T));
+}
+
+// copy len bytes between flat memory and the segments, starting skip bytes
+// into the segments
+template <bool to_segments, typename Segments>
+static void copy_segments(const Segments &segs, uint64_t skip, uint8_t *flat,
+                          uint64_t len) {
+  for (const auto &seg : segs) {
+    if (len == 0) {
+      break;
+    }
+    if (skip >= seg.len) {
+      skip -= seg.len;
+      continue;
+    }
+    const uint64_t n = std::min<uint64_t>(seg.len - skip, len);
+    if constexpr (to_segments) {
+      std::memcpy(seg.host + skip, flat, n);
+    } else {
+      std::memcpy(flat, seg.host + skip, n);
+    }
+    flat += n;
+    len -= n;
+    skip = 0;
+  }
+}
+
+template <typename Segments>
+static uint64_t total_len(const Segments &segs) {
+  uint64_t len = 0;
+  for (const auto &seg : segs) {
+    len += seg.len;
+  }
+  return len;
+}
+
+VirtioBlkDev::VirtioBlkDev(const uint64_t base_addr, SynReadMemoryDev &ram,
+                           const uint64_t dma_addr, const uint64_t dma_size,
+                           const std::string &image, const VirtioBlkMode mode,
+                           const uint64_t request_cycles)
+    : mem_addr(base_addr), ram(ram), dma_addr(dma_addr), dma_size(dma_size),
+      mode(mode), request_cycles(request_cycles) {
+  MY_ASSERT(dma_size > 0 && ram.dma_ptr(dma_addr, dma_size) != nullptr,
+            "virtio-blk DMA window 0x%lx+0x%lx is not in RAM\n", dma_addr,
+            dma_size);
+  const int fd =
+      open(image.c_str(), mode == VirtioBlkMode::shared ? O_RDWR : O_RDONLY);
+  MY_ASSERT(fd >= 0, "can not open disk image %s\n", image.c_str());
+  struct stat st = {};
+  fstat(fd, &st);
+  disk_size = st.st_size / sector_size * sector_size;
+  MY_ASSERT(disk_size > 0, "disk image %s is smaller than one sector\n",
+            image.c_str());
+
+  // cow: MAP_PRIVATE, pages the guest writes are copied, the file is not
+  const int prot =
+      mode == VirtioBlkMode::ro ? PROT_READ : PROT_READ | PROT_WRITE;
+  const int flags = mode == VirtioBlkMode::shared ? MAP_SHARED : MAP_PRIVATE;
+  void *addr = mmap(nullptr, disk_size, prot, flags, fd, 0);
+  close(fd);
+  MY_ASSERT(addr != MAP_FAILED, "mmap disk image %s failed\n", image.c_str());
+  disk = static_cast<uint8_t *>(addr);
+}
+
+VirtioBlkDev::~VirtioBlkDev() {
+  if (disk != nullptr) {
+    munmap(disk, disk_size);
+  }
+}
+
+uint64_t VirtioBlkDev::device_features() const {
+  uint64_t features = feature_version_1 | feature_access_platform |
+                      feature_blk_seg_max | feature_blk_flush;
+  if (mode == VirtioBlkMode::ro) {
+    features |= feature_blk_ro;
+  }
+  return features;
+}
+
+uint8_t *VirtioBlkDev::dma_ptr(const uint64_t addr, const uint64_t len) {
+  if (addr < dma_addr || len > dma_size || addr - dma_addr > dma_size - len)
+      [[unlikely]] {
+    if (dma_faults++ == 0) {
+      spdlog::get("console")->warn(
+          "virtio-blk: DMA to 0x{:x}+0x{:x} outside the uncached window "
+          "0x{:x}+0x{:x}, the DCache may hold stale data",
+          addr, len, dma_addr, dma_size);
+    }
+    return nullptr;
+  }
+  return ram.dma_ptr(addr, len);
+}
+
+uint32_t VirtioBlkDev::read_reg(const uint64_t offset) const {
+  switch (offset) {
+  case reg_magic:
+    return 0x74726976; // "virt"
+  case reg_version:
+    return 2;
+  case reg_device_id:
+    return 2; // block device
+  case reg_vendor_id:
+    return 0x554d4551;
+  case reg_device_features:
+    return device_features_sel > 1
+               ? 0
+               : static_cast<uint32_t>(device_features() >>
+                                       (device_features_sel * 32));
+  case reg_queue_num_max:
+    return queue_sel == 0 ? queue_size : 0;
+  case reg_queue_ready:
+    return queue_ready;
+  case reg_interrupt_status:
+    return interrupt_status;
+  case reg_status:
+    return status;
+  case reg_queue_desc_low:
+    return static_cast<uint32_t>(desc_addr);
+  case reg_queue_desc_high:
+    return static_cast<uint32_t>(desc_addr >> 32);
+  case reg_queue_avail_low:
+    return static_cast<uint32_t>(avail_addr);
+  case reg_queue_avail_high:
+    return static_cast<uint32_t>(avail_addr >> 32);
+  case reg_queue_used_low:
+    return static_cast<uint32_t>(used_addr);
+  case reg_queue_used_high:
+    return static_cast<uint32_t>(used_addr >> 32);
+  case reg_config_generation:
+    return 0;
+  case reg_config + config_capacity:
+    return static_cast<uint32_t>(disk_size / sector_size);
+  case reg_config + config_capacity + 4:
+    return static_cast<uint32_t>(disk_size / sector_size >> 32);
+  case reg_config + config_seg_max:
+    // header and status take one descriptor each
+    return queue_size - 2;
+  default:
+    return 0;
+  }
+}
+
+void VirtioBlkDev::write_reg(const uint64_t offset, const uint32_t value) {
+  // the queue registers only exist for queue 0
+  const bool queue0 = queue_sel == 0;
+  switch (offset) {
+  case reg_device_features_sel:
+    device_features_sel = value;
+    break;
+  case reg_driver_features:
+    if (driver_features_sel <= 1) {
+      const unsigned shift = driver_features_sel * 32;
+      driver_features = (driver_features & ~(0xffffffffULL << shift)) |
+                        static_cast<uint64_t>(value) << shift;
+    }
+    break;
+  case reg_driver_features_sel:
+    driver_features_sel = value;
+    break;
+  case reg_queue_sel:
+    queue_sel = value;
+    break;
+  case reg_queue_num:
+    if (queue0) {
+      queue_num = std::min(value, queue_size);
+    }
+    break;
+  case reg_queue_ready:
+    if (queue0) {
+      queue_ready = value & 1;
+    }
+    break;
+  case reg_queue_notify:
+    if (value == 0) {
+      if (attached()) {
+        notify_event.notify();
+      } else {
+        process_queue();
+      }
+    }
+    break;
+  case reg_interrupt_ack:
+    interrupt_status &= ~value;
+    break;
+  case reg_status:
+    if (value == 0) {
+      reset();
+    } else if ((value & status_features_ok) != 0 &&
+               (driver_features & feature_access_platform) == 0) {
+      // buffers outside the DMA window would not be coherent
+      status = value & ~status_features_ok;
+    } else {
+      status = value;
+    }
+    break;
+  case reg_queue_desc_low:
+    desc_addr = (desc_addr & ~0xffffffffULL) | value;
+    break;
+  case reg_queue_desc_high:
+    desc_addr = (desc_addr & 0xffffffffULL) | static_cast<uint64_t>(value)
+                                                  << 32;
+    break;
+  case reg_queue_avail_low:
+    avail_addr = (avail_addr & ~0xffffffffULL) | value;
+    break;
+  case reg_queue_avail_high:
+    avail_addr = (avail_addr & 0xffffffffULL) | static_cast<uint64_t>(value)
+                                                    << 32;
+    break;
+  case reg_queue_used_low:
+    used_addr = (used_addr & ~0xffffffffULL) | value;
+    break;
+  case reg_queue_used_high:
+    used_addr = (used_addr & 0xffffffffULL) | static_cast<uint64_t>(value)
+                                                  << 32;
+    break;
+  default:
+    // config space is read-only for a block device
+    break;
+  }
+}
+
+void VirtioBlkDev::reset() {
+  device_features_sel = 0;
+  driver_features_sel = 0;
+  driver_features = 0;
+  queue_sel = 0;
+  queue_num = 0;
+  queue_ready = 0;
+  status = 0;
+  interrupt_status = 0;
+  desc_addr = 0;
+  avail_addr = 0;
+  used_addr = 0;
+  last_avail = 0;
+}
+
+void VirtioBlkDev::start_models() {
+  notify_event.bind(sched);
+  sched->spawn(queue_model());
+}
+
+async_simple::coro::Lazy<void> VirtioBlkDev::queue_model() {
+  while (!sched->is_stopping()) {
+    co_await notify_event.wait();
+    // chains made available while a request is in flight are picked up
+    // here, a QueueNotify without a waiter is not lost
+    if (!has_avail()) {
+      continue;
+    }
+    while (has_avail()) {
+      co_await sched->delay(request_cycles);
+      // a reset or a queue reprogrammed during the delay drops the request
+      if (!has_avail()) {
+        break;
+      }
+      complete_next();
+    }
+    end_batch();
+  }
+}
+
+bool VirtioBlkDev::has_avail() {
+  if (queue_ready == 0 || queue_num == 0) {
+    return false;
+  }
+  // struct virtq_avail, without the event idx field
+  const uint8_t *avail = dma_ptr(avail_addr, 4 + 2 * queue_num);
+  return avail != nullptr && load<uint16_t>(avail + 2) != last_avail;
+}
+
+void VirtioBlkDev::complete_next() {
+  const uint8_t *avail = dma_ptr(avail_addr, 4 + 2 * queue_num);
+  // struct virtq_used, without the event idx field
+  uint8_t *used = dma_ptr(used_addr, 4 + 8 * queue_num);
+  if (avail == nullptr || used == nullptr) [[unlikely]] {
+    // the request can not be returned, drop it
+    errors++;
+    last_avail++;
+    return;
+  }
+
+  const auto head = load<uint16_t>(avail + 4 + 2 * (last_avail % queue_num));
+  uint32_t used_len = 0;
+  if (process_chain(head, used_len) != blk_s_ok) {
+    errors++;
+  }
+  auto used_idx = load<uint16_t>(used + 2);
+  uint8_t *elem = used + 4 + 8 * (used_idx % queue_num);
+  store<uint32_t>(elem, head);
+  store<uint32_t>(elem + 4, used_len);
+  store<uint16_t>(used + 2, ++used_idx);
+  last_avail++;
+  requests++;
+}
+
+void VirtioBlkDev::end_batch() {
+  if (queue_ready == 0) {
+    // reset while the batch was in flight
+    return;
+  }
+  batches++;
+  const uint8_t *avail = dma_ptr(avail_addr, 2);
+  if (avail != nullptr &&
+      (load<uint16_t>(avail) & avail_f_no_interrupt) == 0) {
+    interrupt_status |= 1; // used buffer notification
+  }
+}
+
+void VirtioBlkDev::process_queue() {
+  if (!has_avail()) {
+    return;
+  }
+  // every chain made available so far is one batch
+  while (has_avail()) {
+    complete_next();
+  }
+  end_batch();
+}
+
+uint8_t VirtioBlkDev::process_chain(const uint16_t head, uint32_t &used_len) {
+  std::array<Segment, queue_size> segments;
+  size_t readable = 0;
+  size_t count = 0;
+
+  uint16_t idx = head;
+  while (true) {
+    // struct virtq_desc
+    const uint8_t *desc = idx < queue_num
+                              ? dma_ptr(desc_addr + 16 * idx, 16)
+                              : nullptr;
+    if (desc == nullptr || count == queue_num) [[unlikely]] {
+      return blk_s_ioerr;
+    }
+    const auto addr = load<uint64_t>(desc);
+    const auto len = load<uint32_t>(desc + 8);
+    const auto flags = load<uint16_t>(desc + 12);
+    uint8_t *host = dma_ptr(addr, len);
+    // driver-readable buffers come first, then the device-writable ones
+    const bool writable = (flags & desc_f_write) != 0;
+    if (host == nullptr || (!writable && readable != count)) [[unlikely]] {
+      return blk_s_ioerr;
+    }
+    segments[count++] = {.host = host, .len = len};
+    readable += writable ? 0 : 1;
+    if ((flags & desc_f_next) == 0) {
+      break;
+    }
+    idx = load<uint16_t>(desc + 14);
+  }
+
+  return do_request(std::span(segments.data(), readable),
+                    std::span(segments.data() + readable, count - readable),
+                    used_len);
+}
+
+uint8_t VirtioBlkDev::do_request(std::span<const Segment> readable,
+                                 std::span<const Segment> writable,
+                                 uint32_t &used_len) {
+  const uint64_t in_len = total_len(readable);
+  const uint64_t out_len = total_len(writable);
+  // the status byte is the last writable byte, without it nothing can be
+  // reported
+  if (in_len < sizeof(BlkReqHeader) || out_len == 0) [[unlikely]] {
+    return blk_s_ioerr;
+  }
+  BlkReqHeader header = {};
+  copy_segments<false>(readable, 0, reinterpret_cast<uint8_t *>(&header),
+                       sizeof(header));
+  const auto &last = writable.back();
+  uint8_t *status_byte = last.host + last.len - 1;
+
+  const auto in_disk = [this, &header](const uint64_t len) {
+    return header.sector <= disk_size / sector_size &&
+           len <= disk_size - header.sector * sector_size;
+  };
+
+  uint8_t result = blk_s_ok;
+  used_len = 1;
+  switch (header.type) {
+  case blk_t_in: {
+    const uint64_t len = out_len - 1;
+    if (!in_disk(len)) {
+      result = blk_s_ioerr;
+      break;
+    }
+    copy_segments<true>(writable, 0, disk + header.sector * sector_size, len);
+    bytes_read += len;
+    used_len += len;
+    break;
+  }
+  case blk_t_out: {
+    const uint64_t len = in_len - sizeof(header);
+    if (mode == VirtioBlkMode::ro || !in_disk(len)) {
+      result = blk_s_ioerr;
+      break;
+    }
+    copy_segments<false>(readable, sizeof(header),
+                         disk + header.sector * sector_size, len);
+    bytes_written += len;
+    break;
+  }
+  case blk_t_flush:
+    if (mode == VirtioBlkMode::shared) {
+      msync(disk, disk_size, MS_SYNC);
+    }
+    break;
+  case blk_t_get_id: {
+    char id[blk_id_bytes] = "fishsim-virtio-blk";
+    const uint64_t len = std::min<uint64_t>(out_len - 1, blk_id_bytes);
+    copy_segments<true>(writable, 0, reinterpret_cast<uint8_t *>(id), len);
+    used_len += len;
+    break;
+  }
+  default:
+    result = blk_s_unsupp;
+    break;
+  }
+  *status_byte = result;
+  return result;
+}
+
+void VirtioBlkDev::update_inputs(uint64_t read_addr, bool read_en,
+                                 WriteReq write_req, bool write_en) {
+  if (read_en) {
+    DEBUG_ASSERT(in_range(read_addr), "read address out of range");
+    read_slot.put(read_addr);
+  }
+  if (write_en) {
+    DEBUG_ASSERT(in_range(write_req.waddr), "write address out of range");
+    write_slot.put(write_req);
+  }
+}
+
+/**
+ * @brief Registers are 32 bits, an 8-byte aligned access covers two of them.
+ * Reads come before writes, a QueueNotify write wakes the queue model.
+ */
+uint64_t VirtioBlkDev::update_outputs() {
+  if (read_slot.pending()) {
+    const uint64_t offset = Utils::aligned_addr(read_slot.take()) - mem_addr;
+    last_read = read_reg(offset) |
+                static_cast<uint64_t>(read_reg(offset + 4)) << 32;
+  }
+  if (write_slot.pending()) {
+    const auto write_req = write_slot.take();
+    const uint64_t offset = Utils::aligned_addr(write_req.waddr) - mem_addr;
+    if ((write_req.wstrb & 0x0f) != 0) {
+      write_reg(offset, static_cast<uint32_t>(write_req.wdata));
+    }
+    if ((write_req.wstrb & 0xf0) != 0) {
+      write_reg(offset + 4, static_cast<uint32_t>(write_req.wdata >> 32));
+    }
+  }
+  return last_read;
+}
+
+std::vector<AddrInfo> VirtioBlkDev::get_addr_info() {
+  return {{mem_addr, mem_addr + mem_size, "virtio_blk"}};
+}
+
+void VirtioBlkDev::print_stats() const {
+  const auto console = spdlog::get("console");
+  console->info("virtio-blk: {} requests in {} batches, {} bytes read, {} "
+                "bytes written, {} errors, {} DMA faults",
+                requests, batches, bytes_read, bytes_written, errors,
+                dma_faults);
+}
+} // namespace SimDevices
@@ -1,10 +1,23 @@
 #pragma once
 
 #include "DeviceBase.h"
-#include <SDL2/SDL.h>
 #include <readerwriterqueue.h>
 
 namespace SimDevices {
+
+// a key press or release, in SDL terms
+struct KeyEvent {
+  uint32_t scancode; // SDL_Scancode
+  bool is_keydown;
+  // SDL_Keycode typed by a key press, 0 for none
+  int32_t ascii;
+};
+
+/**
+ * @brief AM keyboard. Key events come from the thread that polls SDL (the
+ * AMVGADev render thread) through push_key() and are queued for the guest,
+ * the device never calls into SDL itself.
+ */
 class AMKBDDev final : public DeviceBase {
   uint64_t rtc_time = 0;
   uint64_t mem_addr;
@@ -28,13 +41,15 @@ class AMKBDDev final : public DeviceBase {
       0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
       0,  0,  0,  0};
 
+  // single producer: the thread calling push_key(), single consumer: sim
   moodycamel::ReaderWriterQueue<int> scancode_queue;
-  moodycamel::ReaderWriterQueue<SDL_Keycode> ascii_queue;
+  moodycamel::ReaderWriterQueue<int32_t> ascii_queue;
 
 public:
   explicit AMKBDDev(uint64_t base_addr);
 
-  void create_kdb_thread();
+  // called from one thread only, not necessarily the sim thread
+  void push_key(const KeyEvent &event);
 
   void update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
                      bool write_en) override;
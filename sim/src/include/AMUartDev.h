@@ -1,14 +1,25 @@
 #pragma once
 
-#include "DeviceBase.h"
+#include "CoDeviceBase.h"
+#include <deque>
 
 namespace SimDevices {
-class AMUartDev final : public DeviceBase {
+class AMUartDev final : public CoDeviceBase {
   uint64_t mem_addr;
   uint64_t mem_size;
 
+  // cycles to shift out one character, 0 prints on the cycle after the write
+  uint64_t tx_cycles;
+  std::deque<char> tx_fifo;
+  DeviceEvent tx_event;
+
+  async_simple::coro::Lazy<void> tx_model();
+
+protected:
+  void start_models() override;
+
 public:
-  explicit AMUartDev(uint64_t base);
+  explicit AMUartDev(uint64_t base, uint64_t tx_cycles = 0);
 
   void update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
                      bool write_en) override;
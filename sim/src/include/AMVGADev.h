@@ -1,19 +1,112 @@
 #pragma once
 
 #include "DeviceBase.h"
-#include "SDL_stdinc.h"
-#include <SDL2/SDL.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace SimDevices {
+
+class AMKBDDev;
+
+struct VGACaptureConfig {
+  // one "frame cycle hash" line per sync
+  std::string log_file;
+  // frame_NNNNNN.ppm files
+  std::string dump_dir;
+  // dump every Nth frame
+  uint32_t dump_every = 1;
+};
+
+/**
+ * @brief AM VGA. The guest draws into fbbuff on the sim thread; a sync
+ * copies the rows that changed into a frame and hands it to the render
+ * thread. The render thread is the only one that initializes SDL, owns the
+ * window and polls events; key events go to the AMKBDDev given to
+ * init_screen(). Frames are passed through a three-slot lock-free exchange,
+ * the sim thread never waits for the display: if the render thread has not
+ * taken the last frame yet, that frame is replaced and counted as dropped.
+ *
+ * Without init_screen() the device runs headless. enable_capture() hashes
+ * every frame (and can log and dump it) on the sim thread, with or without a
+ * window. The hash is the sum of Utils::word_hash() over the
+ * framebuffer words, kept up to date on each write.
+ */
 class AMVGADev final : public DeviceBase {
-  SDL_Window *window = nullptr;
-  SDL_Renderer *renderer = nullptr;
-  SDL_Texture *texture = nullptr;
+  // rows [first, last), empty when first >= last
+  struct RowRange {
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+
+    [[nodiscard]] bool empty() const { return first >= last; }
+    void add(const uint32_t row) {
+      first = std::min(first, row);
+      last = std::max(last, row + 1);
+    }
+    void merge(const RowRange &other) {
+      first = std::min(first, other.first);
+      last = std::max(last, other.last);
+    }
+    void clear() { *this = RowRange(); }
+  };
+
+  struct Frame {
+    std::vector<uint8_t> pixels;
+    // rows changed since the frame the render thread showed before this one
+    RowRange upload;
+  };
+
+  // set in frame_middle while the frame there has not been taken
+  static constexpr uint8_t frame_fresh = 0x4;
+
   uint8_t *fbbuff = nullptr;
   uint64_t vga_ctrl_reg = 0;
 
+  std::array<Frame, 3> frames;
+  // owned by the sim thread
+  uint8_t frame_back = 0;
+  // rows written since each frame was last filled
+  std::array<RowRange, 3> stale_rows;
+  // rows written since the last sync
+  RowRange dirty_rows;
+  // rows written since the render thread took a frame
+  RowRange upload_rows;
+  // exchanged by both threads
+  std::atomic<uint8_t> frame_middle = 1;
+  // owned by the render thread
+  uint8_t frame_front = 2;
+
+  std::atomic<uint64_t> frames_published = 0;
+  std::atomic<uint64_t> frames_rendered = 0;
+  uint64_t frames_dropped = 0;
+
+  // the render thread and its SDL state, only after init_screen(); the
+  // header stays free of SDL for headless builds
+  struct Screen;
+  std::unique_ptr<Screen> screen;
+
+  // capture, sim thread only
+  bool capture_en = false;
+  VGACaptureConfig capture;
+  const uint64_t *cycle = nullptr;
+  uint64_t fb_hash = 0;
+  std::ofstream capture_log;
+  uint64_t captured = 0;
+  uint64_t last_frame_cycle = 0;
+  uint64_t last_frame_hash = 0;
+  uint64_t min_frame_cycles = UINT64_MAX;
+  uint64_t max_frame_cycles = 0;
+  uint64_t first_frame_cycle = 0;
+  std::chrono::steady_clock::time_point first_frame_time;
+  std::chrono::steady_clock::time_point last_frame_time;
+
   uint64_t fb_addr_start = 0;
   uint64_t fb_addr_lenth = get_fb_size();
   uint64_t ctrl_addr_start = 0;
@@ -27,19 +120,45 @@ class AMVGADev final : public DeviceBase {
     return get_witdh() * get_height() * sizeof(uint32_t);
   }
 
+  static constexpr uint64_t get_pitch() {
+    return get_witdh() * sizeof(uint32_t);
+  }
+
   void update_screen();
 
+  // sim thread: fill the back frame from fbbuff and swap it in
+  void publish_frame();
+
+  void render_loop(const std::string &name, AMKBDDev *kbd);
+
+  // any thread: interrupt the render thread's wait for events
+  void wake_render();
+
+  void capture_frame();
+
+  void dump_ppm(const std::string &path) const;
+
   uint64_t read(uint64_t addr);
 
   void write(uint64_t addr, uint64_t wdata, uint8_t wstrb);
 
 public:
-  void init_screen(std::string_view name);
+  /**
+   * @param kbd receives the key events of the window, may be nullptr
+   */
+  void init_screen(std::string_view name, AMKBDDev *kbd = nullptr);
+
+  /**
+   * @param cycle timestamp of the frames, e.g. SimBase::cycle_num
+   */
+  void enable_capture(const VGACaptureConfig &config, const uint64_t *cycle);
 
   AMVGADev(uint64_t fb_addr_start, uint64_t ctrl_addr_start);
 
   ~AMVGADev() override;
 
+  void print_stats() const;
+
   void update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
                      bool write_en) override;
 
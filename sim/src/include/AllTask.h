@@ -1,6 +1,14 @@
 #pragma once
 
+#include "DiffTestBatch.h"
+#include "DiffTestMem.h"
+#include "DeviceMange.h"
+#include "DiffTestPipeline.h"
+#include "DramModel.h"
 #include "Itrace.h"
+#include "L2Cache.h"
+#include "L2Options.h"
+#include "MemTrace.h"
 #include "PerfMonitor.h"
 #include "RemoteBitBang.h"
 #include "SimBase.h"
@@ -10,6 +18,35 @@
 
 
 
+struct DiffTestOptions {
+  DiffMode mode = DiffMode::sync;
+  // insts per batch in DiffMode::batch
+  uint64_t batch_size = 4096;
+  // skips and interrupts kept for the batch replay, 0 for no limit
+  uint64_t replay_limit = 1 << 20;
+  DiffCsrCheck csr_check = DiffCsrCheck::incremental;
+  DiffSkipMode skip_mode = DiffSkipMode::dest;
+  // check memory against the reference, off by default
+  bool mem_check = false;
+  DiffMemMode mem_mode = DiffMemMode::stream;
+  // DiffMemMode::page checks every N cycles
+  uint64_t mem_interval = 10000;
+};
+
+struct DramOptions {
+  // "off" or a DramConfig preset
+  std::string preset = "off";
+  // override single preset parameters
+  std::optional<uint32_t> banks;
+  std::optional<uint32_t> row_bytes;
+  std::optional<uint32_t> t_cas;
+  std::optional<uint32_t> t_rcd;
+  std::optional<uint32_t> t_rp;
+  std::optional<uint32_t> t_refi;
+  std::optional<uint32_t> t_rfc;
+  std::optional<uint32_t> queue_depth;
+};
+
 void task_uart_io(SimBase &sim_base);
 void task_perfmonitor(SimBase &sim_base, PerfMonitor &perf_monitor,
                       bool perf_trace_log_en);
@@ -19,7 +56,20 @@ void task_tohost_check(SimBase &sim_base, SimDevices::SynReadMemoryDev &sim_mem,
 void task_deadlock_check(SimBase &sim_base);
 void task_am_ebreak_check(SimBase &sim_base, bool am_en);
 void task_difftest(SimBase &sim_base, std::optional<DiffTest> &diff_ref,
-                   std::string image_name, bool difftest_en);
+                   SimDevices::SynReadMemoryDev &sim_mem,
+                   const SimDevices::DeviceMange &device_manager,
+                   std::string image_name, bool difftest_en,
+                   const DiffTestOptions &options);
+void task_dram(SimBase &sim_base, std::optional<SimDevices::DramModel> &dram,
+               const DramOptions &options);
+void task_mem_trace(SimBase &sim_base,
+                    std::optional<SimDevices::MemTraceWriter> &trace,
+                    SimDevices::DeviceMange &device_manager,
+                    const std::string &trace_file);
+void task_l2(SimBase &sim_base, std::optional<SimDevices::L2Cache> &l2,
+             std::optional<SimDevices::DramModel> &dram,
+             PerfMonitor &perf_monitor, const L2Options &options);
+void task_dpi_mem_check(SimBase &sim_base, bool models_en);
 void task_itrace(SimBase &sim_base, std::optional<Itrace> &itrace,
                  bool itrace_log_enable);
 void task_simjtag(bool rbb_en, int rbb_port, SimBase &sim_base,
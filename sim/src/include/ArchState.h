@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CSREncode.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// CSRs compared by difftest, ArchState::csr follows this order
+constexpr auto diff_csr_addrs =
+    std::array{MISA,    MCAUSE,  MEPC, MTVEC, MSTATUS, MIE,   MTVAL,
+               MEDELEG, MIDELEG, SEPC, STVEC, SCAUSE,  STVAL, SATP};
+
+/**
+ * @brief Architectural state compared by difftest, plain 64-bit words only.
+ */
+struct ArchState {
+  uint64_t pc;
+  std::array<uint64_t, 32> gpr;
+  std::array<uint64_t, diff_csr_addrs.size()> csr;
+
+  // branch free, so the compiler can vectorize it like a memcmp
+  [[nodiscard]] bool same_as(const ArchState &other) const {
+    uint64_t diff = pc ^ other.pc;
+    for (size_t idx = 0; idx < gpr.size(); idx++) {
+      diff |= gpr[idx] ^ other.gpr[idx];
+    }
+    for (size_t idx = 0; idx < csr.size(); idx++) {
+      diff |= csr[idx] ^ other.csr[idx];
+    }
+    return diff == 0;
+  }
+
+  [[nodiscard]] uint64_t hash() const {
+    constexpr uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&](const uint64_t val) {
+      hash ^= val;
+      hash *= prime;
+      hash ^= hash >> 29;
+    };
+    mix(pc);
+    for (const auto val : gpr) {
+      mix(val);
+    }
+    for (const auto val : csr) {
+      mix(val);
+    }
+    return hash;
+  }
+};
+
+static_assert(std::is_trivially_copyable_v<ArchState>);
+static_assert(std::is_standard_layout_v<ArchState>);
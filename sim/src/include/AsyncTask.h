@@ -0,0 +1,133 @@
+#pragma once
+
+#include "async_simple/Executor.h"
+#include "async_simple/Try.h"
+#include "async_simple/coro/Lazy.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A side-effect-free task (trace printing, logging) fed with snapshots
+ * from the sim thread. Snapshots are collected into batches and handed to an
+ * async_simple executor. At most one batch per task is in flight, so the
+ * handler still sees the snapshots in the order they were posted. Without an
+ * executor the handler runs inline on the posting thread.
+ *
+ * post(), flush() and drain() may be called from any thread, e.g. the
+ * difftest reference thread posts its trace while the sim thread drains.
+ */
+template <typename T> class AsyncTask {
+  std::string name;
+  async_simple::Executor *executor;
+  std::function<void(const T &)> handler;
+  size_t batch_size;
+
+  std::mutex batch_mtx;
+  std::vector<T> batch;
+
+  std::mutex mtx;
+  std::condition_variable idle_cv;
+  std::deque<std::vector<T>> ready;
+  bool in_flight = false;
+
+  async_simple::coro::Lazy<void> process(std::vector<T> items) {
+    for (const auto &item : items) {
+      handler(item);
+    }
+    co_return;
+  }
+
+  void launch(std::vector<T> items) {
+    process(std::move(items))
+        .via(executor)
+        .start([this](async_simple::Try<void> &&) {
+          std::vector<T> next;
+          {
+            std::lock_guard lock(mtx);
+            if (ready.empty()) {
+              // notify under the lock, drain() may destroy us once it wakes
+              in_flight = false;
+              idle_cv.notify_all();
+              return;
+            }
+            next = std::move(ready.front());
+            ready.pop_front();
+          }
+          launch(std::move(next));
+        });
+  }
+
+  // batch_mtx held, so batches reach ready in post() order
+  void flush_locked() {
+    if (batch.empty()) {
+      return;
+    }
+    {
+      std::lock_guard lock(mtx);
+      ready.emplace_back(std::move(batch));
+    }
+    batch = std::vector<T>();
+    batch.reserve(batch_size);
+    kick();
+  }
+
+  void kick() {
+    std::vector<T> items;
+    {
+      std::lock_guard lock(mtx);
+      if (in_flight || ready.empty()) {
+        return;
+      }
+      items = std::move(ready.front());
+      ready.pop_front();
+      in_flight = true;
+    }
+    launch(std::move(items));
+  }
+
+public:
+  AsyncTask(std::string name, async_simple::Executor *executor,
+            std::function<void(const T &)> handler, size_t batch_size)
+      : name(std::move(name)), executor(executor),
+        handler(std::move(handler)), batch_size(batch_size) {
+    batch.reserve(batch_size);
+  }
+
+  AsyncTask(const AsyncTask &) = delete;
+  AsyncTask &operator=(const AsyncTask &) = delete;
+
+  ~AsyncTask() { drain(); }
+
+  [[nodiscard]] const std::string &get_name() const { return name; }
+
+  void post(const T &item) {
+    if (executor == nullptr) {
+      handler(item);
+      return;
+    }
+    std::lock_guard batch_lock(batch_mtx);
+    batch.emplace_back(item);
+    if (batch.size() >= batch_size) {
+      flush_locked();
+    }
+  }
+
+  // hand the current partial batch to the executor
+  void flush() {
+    std::lock_guard batch_lock(batch_mtx);
+    flush_locked();
+  }
+
+  // flush and wait until every posted snapshot has been handled
+  void drain() {
+    flush();
+    std::unique_lock lock(mtx);
+    idle_cv.wait(lock, [this] { return !in_flight && ready.empty(); });
+  }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "DeviceBase.h"
+#include "DeviceScheduler.h"
+
+namespace SimDevices {
+/**
+ * @brief A device whose behaviour over time is written as coroutine models on
+ * the DeviceMange scheduler. The port side stays synchronous, update_inputs()
+ * and update_outputs() only latch requests and notify events, the models do
+ * the multi-cycle work.
+ */
+class CoDeviceBase : public DeviceBase {
+protected:
+  DeviceScheduler *sched = nullptr;
+
+  // bind events and spawn the models, called once from attach()
+  virtual void start_models() = 0;
+
+public:
+  void attach(DeviceScheduler *scheduler) {
+    sched = scheduler;
+    start_models();
+  }
+
+  [[nodiscard]] bool attached() const { return sched != nullptr; }
+};
+} // namespace SimDevices
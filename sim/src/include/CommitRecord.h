@@ -0,0 +1,64 @@
+#pragma once
+
+#include "VtopBindings.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class SimBase;
+
+struct CommitInstInfo {
+  uint64_t pc;
+  uint32_t inst;
+  bool is_rvc;
+};
+
+// a committed store, taken from the store queue when it commits, before it
+// reaches the DCache
+struct CommitStore {
+  bool valid = false;
+  uint64_t paddr = 0;
+  uint64_t wdata = 0;
+  uint8_t wstrb = 0;
+};
+
+/**
+ * @brief io_difftest of one committing cycle, decoded once by SimBase and
+ * shared by every commit listener. GPRs and CSRs are not copied, gpr() and
+ * csr() read the current value from the model on demand.
+ */
+struct CommitRecord {
+  static constexpr size_t max_commit_width = VtopBindings::commit_width;
+
+  uint64_t cycle = 0;
+  uint8_t commit_num = 0;
+  std::array<CommitInstInfo, max_commit_width> inst_info{};
+
+  // last committed instruction
+  uint64_t pc = 0;
+  uint32_t inst = 0;
+  bool is_rvc = false;
+
+  bool has_exception = false;
+  bool has_interrupt = false;
+  uint64_t cause = 0;
+  uint64_t tval = 0;
+  bool has_mmio = false;
+  bool csr_skip = false;
+  // at most one store commits per cycle, mmio stores are not reported
+  CommitStore store{};
+
+  const SimBase *sim = nullptr;
+
+  [[nodiscard]] uint64_t next_pc() const { return pc + (is_rvc ? 2 : 4); }
+
+  [[nodiscard]] uint64_t gpr(size_t idx) const;
+
+  [[nodiscard]] uint64_t csr(size_t addr) const;
+};
+
+struct CommitListener_t {
+  std::function<void(const CommitRecord &)> listener_func;
+  std::string name;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Utils.h"
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -17,12 +18,42 @@ struct AddrInfo {
   std::string name;
 };
 
+/**
+ * @brief A request latched by update_inputs() and consumed by the next
+ * update_outputs(). The memory port issues at most one read and one write per
+ * cycle, so one slot per direction is enough and nothing is allocated on the
+ * access path.
+ */
+template <typename T> class RequestSlot {
+  T req{};
+  bool valid = false;
+
+public:
+  void put(const T &new_req) {
+    DEBUG_ASSERT(!valid, "request slot overrun\n");
+    req = new_req;
+    valid = true;
+  }
+
+  [[nodiscard]] bool pending() const { return valid; }
+
+  T take() {
+    DEBUG_ASSERT(valid, "request slot empty\n");
+    valid = false;
+    return req;
+  }
+};
+
 class DeviceBase {
 
 public:
   uint64_t last_read = 0;
-  std::vector<uint64_t> read_req_seq;
-  std::vector<WriteReq> write_req_seq;
+  RequestSlot<uint64_t> read_slot;
+  RequestSlot<WriteReq> write_slot;
+
+  [[nodiscard]] bool has_pending() const {
+    return read_slot.pending() || write_slot.pending();
+  }
 
   virtual bool in_range(uint64_t addr) = 0;
 
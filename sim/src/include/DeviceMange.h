@@ -1,19 +1,80 @@
 #pragma once
 
 #include "DeviceBase.h"
+#include "DeviceScheduler.h"
+#include <optional>
 
 namespace SimDevices {
+class SynReadMemoryDev;
+class MemTraceWriter;
+
 class DeviceMange {
+  // one address range of a device, see DeviceBase::get_addr_info()
+  struct Route {
+    uint64_t start = 0;
+    uint64_t end = 0;
+    DeviceBase *device = nullptr;
+
+    [[nodiscard]] bool contains(const uint64_t addr) const {
+      return addr - start < end - start;
+    }
+  };
+
   std::vector<DeviceBase *> device_pool;
+  // every range of every device, sorted by start, never overlapping
+  std::vector<Route> routes;
+
+  // RAM takes almost every access, it is decoded first and, being a final
+  // class, called without going through the vtable
+  SynReadMemoryDev *ram = nullptr;
+  Route ram_route;
+  // last hit among the other devices, MMIO accesses come in runs
+  Route mru_route;
+
+  // devices that latched a request in the last update_inputs()
+  DeviceBase *read_device = nullptr;
+  DeviceBase *write_device = nullptr;
+  uint64_t last_read = 0;
+
+  // resumes the coroutine models of CoDeviceBase devices
+  DeviceScheduler scheduler;
+
+  // mem_port trace, requests are recorded once their read data is known
+  MemTraceWriter *trace = nullptr;
+  uint64_t trace_cycle = 0;
+  uint64_t trace_raddr = 0;
+  WriteReq trace_wreq{};
+
+  void trace_requests();
 
   bool is_conflict(uint64_t start, uint64_t end) const;
 
+  DeviceBase *find_device(uint64_t addr);
+
+  uint64_t device_outputs(DeviceBase *device);
+
 public:
   void add_device(DeviceBase *device);
 
   void print_device_info() const;
 
-  uint64_t update_outputs() const;
+  // record every routed mem_port request to trace, nullptr to stop
+  void set_trace(MemTraceWriter *writer) { trace = writer; }
+
+  std::optional<std::string> device_name(uint64_t addr) const;
+
+  uint64_t update_outputs();
+
+  // nothing latched by the last update_inputs(), update_outputs() would only
+  // tick the scheduler
+  [[nodiscard]] bool idle() const {
+    return read_device == nullptr && write_device == nullptr;
+  }
+
+  void tick() { scheduler.tick(); }
+
+  // stop the device models, before any device is destroyed
+  void shutdown() { scheduler.shutdown(); }
 
   bool update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
                      bool write_en);
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "async_simple/Executor.h"
+#include "async_simple/coro/Lazy.h"
+#include <coroutine>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+namespace SimDevices {
+class DeviceScheduler;
+
+/**
+ * @brief Something a device model can co_await until another part of the
+ * device (usually update_inputs/update_outputs) calls notify(). Waiters are
+ * resumed by the scheduler on its next tick, never from inside notify().
+ */
+class DeviceEvent {
+  friend class DeviceScheduler;
+
+  DeviceScheduler *sched = nullptr;
+  std::vector<std::coroutine_handle<>> waiters;
+  bool parked = false;
+
+public:
+  struct Awaiter {
+    DeviceEvent *event;
+
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> handle) const;
+    void await_resume() const noexcept {}
+    // picked up by Lazy's await_transform, models resume on the sim thread
+    Awaiter coAwait(async_simple::Executor *) const { return *this; }
+  };
+
+  DeviceEvent() = default;
+  DeviceEvent(const DeviceEvent &) = delete;
+  DeviceEvent &operator=(const DeviceEvent &) = delete;
+
+  void bind(DeviceScheduler *scheduler) { sched = scheduler; }
+
+  [[nodiscard]] Awaiter wait() { return {this}; }
+
+  void notify();
+};
+
+/**
+ * @brief Cycle-driven scheduler for coroutine device models. A model is a
+ * Lazy<void> started on the sim thread that co_awaits delay(n) or a
+ * DeviceEvent. Suspended models sit in a min-heap keyed by the cycle they are
+ * due, tick() only resumes those, so an idle model costs one compare per
+ * cycle for the whole scheduler.
+ */
+class DeviceScheduler {
+  struct Wakeup {
+    uint64_t cycle;
+    uint64_t seq;
+    std::coroutine_handle<> handle;
+
+    // models due on the same cycle resume in the order they suspended
+    bool operator>(const Wakeup &other) const {
+      return cycle != other.cycle ? cycle > other.cycle : seq > other.seq;
+    }
+  };
+
+  std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<>> wakeups;
+  uint64_t wakeup_seq = 0;
+  uint64_t now = 0;
+  bool stopping = false;
+  size_t running = 0;
+
+  // events with at least one waiter, resumed by shutdown()
+  std::vector<DeviceEvent *> parked_events;
+
+  friend class DeviceEvent;
+
+  void resume_due();
+
+public:
+  struct DelayAwaiter {
+    DeviceScheduler *sched;
+    uint64_t cycles;
+
+    bool await_ready() const noexcept {
+      return cycles == 0 || sched->stopping;
+    }
+    void await_suspend(std::coroutine_handle<> handle) const {
+      sched->wake_at(sched->now + cycles, handle);
+    }
+    void await_resume() const noexcept {}
+    DelayAwaiter coAwait(async_simple::Executor *) const { return *this; }
+  };
+
+  DeviceScheduler() = default;
+  DeviceScheduler(const DeviceScheduler &) = delete;
+  DeviceScheduler &operator=(const DeviceScheduler &) = delete;
+
+  /**
+   * @brief Start a model, it runs inline up to its first co_await. Models
+   * loop until is_stopping(), shutdown() resumes them one last time.
+   */
+  void spawn(async_simple::coro::Lazy<void> model);
+
+  [[nodiscard]] DelayAwaiter delay(const uint64_t cycles) {
+    return {this, cycles};
+  }
+
+  void wake_at(uint64_t cycle, std::coroutine_handle<> handle);
+
+  // called once per cycle, before the devices see the port
+  void tick() {
+    now++;
+    if (!wakeups.empty() && wakeups.top().cycle <= now) [[unlikely]] {
+      resume_due();
+    }
+  }
+
+  [[nodiscard]] uint64_t get_now() const { return now; }
+
+  [[nodiscard]] bool is_stopping() const { return stopping; }
+
+  /**
+   * @brief Let every model run to completion. Must be called while the
+   * devices owning the models are still alive.
+   */
+  void shutdown();
+};
+} // namespace SimDevices
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "difftest.hpp"
+#include "spdlog/spdlog.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Lazy difftest for long runs. Plain commits are only folded into a
+ * rolling hash of the DUT state, the reference is stepped once per batch and
+ * compared at the batch boundary. MMIO/CSR skips and interrupts close the
+ * batch and are checked one by one as in sync mode.
+ *
+ * rv64emu has no snapshot, so on a mismatch the reference is recreated and
+ * every step/skip/interrupt since boot is replayed up to the last good
+ * boundary, the start of the failing batch. The batch is then stepped commit
+ * by commit and the rolling hash tells the first divergent instruction.
+ * Replay costs O(run length): it re-executes every reference step of the run.
+ *
+ * Steps between two skips are logged as one count. A skip carries the DUT
+ * values of its destination GPRs, which the reference cannot regenerate (MMIO
+ * loads), so it is logged as a small SkipRecord. Past replay_limit skips and
+ * interrupts the log is dropped: mismatches are still found at the batch
+ * boundary, but no longer narrowed down to one commit.
+ */
+class DiffTestBatch {
+  struct BatchEntry {
+    uint64_t seq;
+    uint64_t cycle;
+    uint64_t pc;
+    uint8_t commit_num;
+    uint64_t roll;
+  };
+
+  struct ReplayEvent {
+    enum Kind : uint8_t { step, skip, intr } kind;
+    // steps, index into skip_records or irq number
+    uint64_t arg;
+  };
+
+  // the part of a MMIO/csr_skip commit the reference needs to redo it
+  struct SkipRecord {
+    uint64_t next_pc;
+    uint8_t commit_num;
+    std::array<uint8_t, CommitRecord::max_commit_width> dest_gpr;
+    std::array<uint64_t, CommitRecord::max_commit_width> dest_value;
+  };
+
+  DiffTest &diff_ref;
+  const uint64_t batch_size;
+  const uint64_t replay_limit;
+
+  std::vector<BatchEntry> batch;
+  uint64_t pending_steps = 0;
+  uint64_t roll = 0;
+  uint64_t batch_start_roll = 0;
+  // DUT state of the last commit in the batch
+  DiffCommit last_commit;
+
+  std::vector<ReplayEvent> replay_log;
+  std::vector<SkipRecord> skip_records;
+  // skips and interrupts in the log
+  uint64_t replay_events = 0;
+  bool replay_en = true;
+  // reference steps up to the last good boundary
+  uint64_t good_steps = 0;
+
+  uint64_t batch_num = 0;
+  uint64_t exact_check_num = 0;
+
+  std::shared_ptr<spdlog::logger> console;
+
+  void log_steps(uint64_t steps);
+  void log_event(const ReplayEvent &event);
+  void replay();
+
+public:
+  /**
+   * @param replay_limit skips and interrupts kept for the replay, 0 for no
+   * limit
+   */
+  DiffTestBatch(DiffTest &diff_ref, uint64_t batch_size,
+                uint64_t replay_limit);
+
+  /**
+   * @brief Add one commit, may close the batch and check it.
+   * @return false on mismatch
+   */
+  bool push(const DiffCommit &commit);
+
+  /**
+   * @brief Step the reference over the open batch and compare.
+   * @return false on mismatch
+   */
+  bool flush();
+
+  void print_stats() const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "SramMemoryDev.h"
+#include "difftest.hpp"
+#include "spdlog/spdlog.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// stream: compare every committed store from io_difftest with the reference,
+// see DiffTest::check_store
+// page: compare the hashes of the pages written since the last check,
+// unreliable, see DiffTestMem
+enum class DiffMemMode { stream, page };
+
+/**
+ * @brief Compares the pages written to SynReadMemoryDev with the reference
+ * memory. Unreliable: the DCache is write back, so memory does not hold the
+ * lines that are still dirty in it, and a line that stays dirty across two
+ * checks is reported although the DUT is right. A mismatching word is only
+ * reported when it still differs on the next check and the DUT did not write
+ * it again meanwhile, which hides most but not all of these. Prefer
+ * DiffMemMode::stream.
+ */
+class DiffTestMem {
+  struct Suspect {
+    uint64_t addr;
+    uint64_t mask;
+    uint64_t dut_value;
+    uint64_t ref_value;
+  };
+
+  DiffTest &diff_ref;
+  SimDevices::SynReadMemoryDev &sim_mem;
+  std::optional<uint64_t> to_host_addr;
+
+  std::vector<Suspect> suspects;
+  std::vector<Suspect> next_suspects;
+  std::vector<uint8_t> page_buf;
+
+  uint64_t check_num = 0;
+  uint64_t page_check_num = 0;
+
+  std::shared_ptr<spdlog::logger> console;
+
+  uint64_t ref_word(uint64_t addr) const;
+  void check_word(uint64_t addr, uint64_t mask);
+  void check_pages();
+
+public:
+  DiffTestMem(DiffTest &diff_ref, SimDevices::SynReadMemoryDev &sim_mem);
+
+  /**
+   * @return false once a mismatch is confirmed
+   */
+  bool check();
+
+  void print_stats() const;
+};
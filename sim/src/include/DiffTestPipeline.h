@@ -0,0 +1,75 @@
+#pragma once
+
+#include "difftest.hpp"
+#include "spdlog/spdlog.h"
+#include <readerwritercircularbuffer.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/**
+ * @brief Runs the reference model on its own thread. The sim thread only
+ * copies each commit into a bounded SPSC queue and keeps going, the reference
+ * thread steps and compares behind it. When the queue is full the sim thread
+ * waits, so the DUT never runs more than max_inflight commits ahead and stops
+ * within that bound after a divergence.
+ *
+ * The reference thread starts with the first push() and is joined by stop(),
+ * which the owner calls at the end of every run, while the DiffTest it steps
+ * is still alive.
+ */
+class DiffTestPipeline {
+  DiffTest &diff_ref;
+  // fixed capacity, wait_enqueue() blocks instead of growing the queue
+  moodycamel::BlockingReaderWriterCircularBuffer<DiffCommit> queue;
+  const size_t max_inflight;
+
+  std::thread ref_thread;
+  std::atomic<bool> stop_requested = false;
+  std::atomic<bool> mismatch_found = false;
+  std::atomic<uint64_t> checked_num = 0;
+
+  // owned by the sim thread
+  uint64_t pushed_num = 0;
+
+  // written by the reference thread before mismatch_found is set
+  DiffCommit first_mismatch;
+
+  std::shared_ptr<spdlog::logger> console;
+
+  void ref_loop();
+  void check(const DiffCommit &commit);
+  void start();
+
+public:
+  DiffTestPipeline(DiffTest &diff_ref, size_t max_inflight);
+
+  DiffTestPipeline(const DiffTestPipeline &) = delete;
+  DiffTestPipeline &operator=(const DiffTestPipeline &) = delete;
+
+  ~DiffTestPipeline();
+
+  /**
+   * @brief Queue one commit for the reference thread, waits while the queue
+   * is full.
+   * @return false once the reference has found a mismatch
+   */
+  bool push(const DiffCommit &commit);
+
+  /**
+   * @brief Wait until the reference has checked every pushed commit.
+   * @return false if a mismatch was found
+   */
+  bool sync();
+
+  // check the pushed commits and join the reference thread
+  void stop();
+
+  [[nodiscard]] bool has_mismatch() const {
+    return mismatch_found.load(std::memory_order_acquire);
+  }
+
+  void report_mismatch() const;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "DramModel.h"
+#include "L2Cache.h"
+#include "MemTrace.h"
+#include "SramMemoryDev.h"
+
+namespace SimDevices {
+/**
+ * @brief Route the DPI-C memory port (AXI4DpiMemory in FishSoc) to mem. Must
+ * be called before the first clock edge when the SoC was generated with
+ * dpi_mem_en.
+ */
+void bind_dpi_memory(SynReadMemoryDev *mem);
+
+/**
+ * @brief Time DPI-C bursts with dram, cycle is read on every burst. nullptr
+ * turns the model off, bursts then take the fixed AXI latency.
+ */
+void bind_dpi_dram(DramModel *dram, const uint64_t *cycle);
+
+/**
+ * @brief Time DPI-C bursts with l2 in front of the DRAM model, takes over
+ * from bind_dpi_dram(). nullptr removes the cache.
+ */
+void bind_dpi_l2(L2Cache *l2, const uint64_t *cycle);
+
+/**
+ * @brief Record every DPI-C burst to trace, nullptr to stop.
+ */
+void bind_dpi_trace(MemTraceWriter *trace);
+
+/**
+ * @brief Bursts served over the DPI-C port so far, stays 0 when the SoC was
+ * generated with --no-dpi-mem.
+ */
+uint64_t dpi_bursts();
+} // namespace SimDevices
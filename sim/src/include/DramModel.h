@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SimDevices {
+
+/**
+ * @brief DRAM parameters, all timings in core cycles. Presets assume a 1 GHz
+ * core clock.
+ */
+struct DramConfig {
+  std::string name;
+  uint32_t banks;     // power of two
+  uint32_t row_bytes; // power of two
+  uint32_t t_cas;     // column command to first data
+  uint32_t t_rcd;     // activate to column command
+  uint32_t t_rp;      // precharge
+  uint32_t t_burst;   // data bus cycles per 8-byte beat
+  uint32_t t_refi;    // refresh interval, 0 to disable refresh
+  uint32_t t_rfc;     // all banks busy for this long on every refresh
+  uint32_t queue_depth;
+
+  static std::optional<DramConfig> preset(std::string_view name);
+  static std::vector<std::string> preset_names();
+};
+
+struct DramStats {
+  // latency histogram bucket i counts latencies in [2^(i-1), 2^i), bucket 0
+  // counts zero
+  static constexpr size_t hist_buckets = 16;
+
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t bytes = 0;
+  uint64_t row_hits = 0;
+  uint64_t row_empty = 0;
+  uint64_t row_conflicts = 0;
+  uint64_t refreshes = 0;
+  uint64_t queue_stalls = 0;
+  uint64_t read_latency_sum = 0;
+  uint64_t write_latency_sum = 0;
+  std::array<uint64_t, hist_buckets> read_hist{};
+  std::array<uint64_t, hist_buckets> write_hist{};
+  uint64_t first_cycle = 0;
+  uint64_t last_cycle = 0;
+};
+
+/**
+ * @brief Bank/row-buffer timing model for main memory. It does not hold any
+ * data, access() only tells how long a burst takes given the state left by
+ * the earlier ones: open-page policy, one open row per bank, a shared data
+ * bus, periodic all-bank refresh and at most queue_depth bursts in flight.
+ * Every call is O(1), idle time between accesses costs nothing.
+ */
+class DramModel {
+  struct Bank {
+    bool row_open = false;
+    uint64_t row = 0;
+    // earliest cycle the next command to this bank can start
+    uint64_t ready = 0;
+  };
+
+  DramConfig config;
+  uint32_t row_shift;
+  uint32_t bank_mask;
+
+  std::vector<Bank> banks;
+  uint64_t bus_free = 0;
+  uint64_t next_refresh;
+  // completion cycle of the bursts in flight, oldest at inflight_head
+  std::vector<uint64_t> inflight;
+  size_t inflight_head = 0;
+
+  DramStats stats;
+
+  void refresh_until(uint64_t now);
+
+public:
+  explicit DramModel(const DramConfig &config);
+
+  /**
+   * @brief Account one burst of beats 8-byte beats arriving at cycle now.
+   * @return cycles until the first read beat is on the bus, or until a write
+   * burst has been stored
+   */
+  uint32_t access(uint64_t now, uint64_t addr, uint32_t beats, bool is_write);
+
+  [[nodiscard]] const DramConfig &get_config() const { return config; }
+  [[nodiscard]] const DramStats &get_stats() const { return stats; }
+
+  void print_stats() const;
+};
+} // namespace SimDevices
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace SimDevices {
+
+/**
+ * @brief Converts an ELF once into a flat memory image plus a symbol index,
+ * keyed by the hash of the file content and the guest RAM, so later runs can
+ * mmap the image as guest RAM instead of parsing and copying the ELF again.
+ *
+ * Cache layout: <dir>/<hash>_<mem_addr>_<mem_size>.img is the guest RAM from
+ * mem_addr on (sparse, page aligned length), the .sym next to it holds one
+ * "name value" per line. <dir>/<dev>_<inode>_<size>_<mtime>.ref holds the
+ * content hash of one version of a file, so the file is only read again once
+ * it was rewritten. All files are written to a temp file and renamed, so
+ * parallel simulators can share one cache directory.
+ */
+class ImageCache {
+  std::filesystem::path cache_dir;
+
+  bool build(const std::string &file_name, uint64_t mem_addr,
+             uint64_t mem_size, const std::filesystem::path &img_path,
+             const std::filesystem::path &sym_path) const;
+  // content hash of file_name, through the .ref of its current version
+  std::optional<uint64_t> content_hash(const std::string &file_name) const;
+
+public:
+  struct Image {
+    std::string path;
+    uint64_t size;
+    std::unordered_map<std::string, uint64_t> symbols;
+  };
+
+  explicit ImageCache(std::filesystem::path cache_dir);
+
+  /**
+   * @brief Image for file_name, a raw binary is used as its own image.
+   * @return std::nullopt if the file can not be converted
+   */
+  std::optional<Image> get(const std::string &file_name, uint64_t mem_addr,
+                           uint64_t mem_size) const;
+};
+} // namespace SimDevices
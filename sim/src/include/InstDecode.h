@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Coarse class of a committed instruction, used by difftest to decide
+ * how much state can have changed.
+ */
+enum class InstClass : uint8_t {
+  plain,   // only pc and the destination GPR change
+  csr_op,  // csrrw/csrrs/csrrc and the immediate forms
+  trap,    // ecall, ebreak, c.ebreak
+  xret,    // mret, sret
+  sfence,  // sfence.vma
+  unknown, // not decoded, treat as if anything changed
+};
+
+inline InstClass classify_inst(const uint32_t inst, const bool is_rvc) {
+  if (is_rvc) {
+    // c.ebreak is the only compressed instruction that is not plain
+    return (inst & 0xffff) == 0x9002 ? InstClass::trap : InstClass::plain;
+  }
+
+  constexpr uint32_t OPCODE_SYSTEM = 0x73;
+  if ((inst & 0x7f) != OPCODE_SYSTEM) {
+    return InstClass::plain;
+  }
+
+  const uint32_t funct3 = (inst >> 12) & 0x7;
+  if (funct3 != 0) {
+    return funct3 == 0x4 ? InstClass::unknown : InstClass::csr_op;
+  }
+
+  switch (inst) {
+  case 0x00000073: // ecall
+  case 0x00100073: // ebreak
+    return InstClass::trap;
+  case 0x30200073: // mret
+  case 0x10200073: // sret
+    return InstClass::xret;
+  case 0x10500073: // wfi
+    return InstClass::plain;
+  default:
+    break;
+  }
+  if ((inst >> 25) == 0x09) { // sfence.vma
+    return InstClass::sfence;
+  }
+  return InstClass::unknown;
+}
+
+/**
+ * @brief Destination GPR written by a committed instruction, 0 when it writes
+ * none (x0 never differs, so it can be compared anyway).
+ */
+inline uint8_t inst_dest_gpr(const uint32_t inst, const bool is_rvc) {
+  if (is_rvc) {
+    const uint32_t op = inst & 0x3;
+    const uint32_t funct3 = (inst >> 13) & 0x7;
+    const auto rd = static_cast<uint8_t>((inst >> 7) & 0x1f);
+    const auto rd_prime = static_cast<uint8_t>(((inst >> 2) & 0x7) + 8);
+    const auto rs2 = (inst >> 2) & 0x1f;
+
+    switch (op) {
+    case 0x0: // c.addi4spn, c.lw, c.ld
+      return funct3 <= 0x3 ? rd_prime : 0;
+    case 0x1:
+      if (funct3 <= 0x3) { // c.addi, c.addiw, c.li, c.lui/c.addi16sp
+        return rd;
+      }
+      if (funct3 == 0x4) { // c.srli ... c.and
+        return static_cast<uint8_t>(((inst >> 7) & 0x7) + 8);
+      }
+      return 0; // c.j, c.beqz, c.bnez
+    case 0x2:
+      if (funct3 <= 0x3) { // c.slli, c.lwsp, c.ldsp
+        return rd;
+      }
+      if (funct3 == 0x4) {
+        const bool bit12 = (inst >> 12) & 0x1;
+        if (rs2 != 0) { // c.mv, c.add
+          return rd;
+        }
+        return bit12 && rd != 0 ? 1 : 0; // c.jalr writes ra, c.jr none
+      }
+      return 0; // c.swsp, c.sdsp
+    default:
+      return 0;
+    }
+  }
+
+  switch (inst & 0x7f) {
+  case 0x37: // lui
+  case 0x17: // auipc
+  case 0x6f: // jal
+  case 0x67: // jalr
+  case 0x03: // load
+  case 0x13: // op-imm
+  case 0x33: // op
+  case 0x1b: // op-imm-32
+  case 0x3b: // op-32
+  case 0x2f: // amo
+  case 0x73: // csr
+    return static_cast<uint8_t>((inst >> 7) & 0x1f);
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Base register and offset of a load, store or AMO, used to find the
+ * address of an MMIO access.
+ * @return false if the instruction does not access memory (or uses a form
+ * that is not decoded, like the sp based compressed ones)
+ */
+inline bool inst_mem_operand(const uint32_t inst, const bool is_rvc,
+                             uint8_t &rs1, int64_t &imm) {
+  if (is_rvc) {
+    const uint32_t op = inst & 0x3;
+    const uint32_t funct3 = (inst >> 13) & 0x7;
+    // c.lw, c.ld, c.sw, c.sd
+    if (op != 0x0 || (funct3 & 0x3) < 0x2) {
+      return false;
+    }
+    rs1 = static_cast<uint8_t>(((inst >> 7) & 0x7) + 8);
+    const uint32_t uimm_5_3 = ((inst >> 10) & 0x7) << 3;
+    if ((funct3 & 0x1) == 0) { // word
+      imm = uimm_5_3 | ((inst >> 6) & 0x1) << 2 | ((inst >> 5) & 0x1) << 6;
+    } else { // double
+      imm = uimm_5_3 | ((inst >> 5) & 0x3) << 6;
+    }
+    return true;
+  }
+
+  const auto signed_inst = static_cast<int32_t>(inst);
+  rs1 = static_cast<uint8_t>((inst >> 15) & 0x1f);
+  switch (inst & 0x7f) {
+  case 0x03: // load
+    imm = signed_inst >> 20;
+    return true;
+  case 0x23: // store
+    // stay signed, or the low bits promote the offset to unsigned
+    imm = static_cast<int64_t>(signed_inst >> 25) * 32 |
+          static_cast<int64_t>((inst >> 7) & 0x1f);
+    return true;
+  case 0x2f: // amo
+    imm = 0;
+    return true;
+  default:
+    return false;
+  }
+}
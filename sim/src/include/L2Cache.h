@@ -0,0 +1,73 @@
+#pragma once
+
+#include "DramModel.h"
+#include <cstdint>
+#include <vector>
+
+namespace SimDevices {
+
+enum class L2Replacement { lru, fifo, random };
+
+struct L2Config {
+  uint64_t size = 256 * 1024; // size / (ways * line_bytes) a power of two
+  uint32_t ways = 8;
+  uint32_t line_bytes = 64; // power of two, at least one 8-byte beat
+  L2Replacement replacement = L2Replacement::lru;
+  uint32_t hit_latency = 12;
+  // added on a miss when there is no DRAM model behind the cache
+  uint32_t miss_penalty = 0;
+};
+
+/**
+ * @brief Tag-only model of a shared last-level cache between the core's AXI
+ * port and main memory. The data stays in SynReadMemoryDev, access() only
+ * tells how long a burst takes: hit_latency on a hit, plus the line fill from
+ * the DRAM model (or miss_penalty) on a miss. Write-back, write-allocate; a
+ * write covering a whole line allocates it without a fill. Dirty victims are
+ * written back to the DRAM model off the critical path.
+ */
+class L2Cache {
+  struct Line {
+    uint64_t tag = 0;
+    bool valid = false;
+    bool dirty = false;
+    // last use for lru, fill time for fifo
+    uint64_t stamp = 0;
+  };
+
+  L2Config config;
+  DramModel *dram;
+  uint32_t line_shift;
+  uint32_t set_shift;
+  uint64_t set_mask;
+  uint32_t line_beats;
+  std::vector<Line> lines;
+  uint64_t clock = 0;
+  uint64_t rng = 0x2545f4914f6cdd1dULL;
+
+  Line &victim(size_t set);
+  uint32_t access_line(uint64_t now, uint64_t line_addr, bool is_write,
+                       bool full_line);
+
+public:
+  // counters, read by PerfMonitor through pointers
+  uint64_t accesses = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t writebacks = 0;
+
+  /**
+   * @param dram memory behind the cache, nullptr for a fixed miss_penalty
+   */
+  L2Cache(const L2Config &config, DramModel *dram);
+
+  /**
+   * @brief Account one burst of beats 8-byte beats arriving at cycle now.
+   * @return cycles until the first read beat is available, or until a write
+   * burst has been stored
+   */
+  uint32_t access(uint64_t now, uint64_t addr, uint32_t beats, bool is_write);
+
+  [[nodiscard]] const L2Config &get_config() const { return config; }
+};
+} // namespace SimDevices
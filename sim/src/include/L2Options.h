@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CLI/CLI.hpp"
+#include "L2Cache.h"
+#include <map>
+#include <string>
+
+struct L2Options {
+  bool enable = false;
+  SimDevices::L2Config config;
+};
+
+/**
+ * @brief The --l2* options, shared by the simulator and MemReplay.
+ */
+inline void add_l2_options(CLI::App &app, L2Options &options) {
+  app.add_flag("--l2", options.enable,
+               "model a shared L2 cache in front of main memory")
+      ->default_val(false);
+  app.add_option("--l2-size", options.config.size, "L2 size, e.g. 512K")
+      ->transform(CLI::AsSizeValue(false))
+      ->default_str("256K");
+  app.add_option("--l2-ways", options.config.ways, "L2 associativity")
+      ->default_val(8);
+  app.add_option("--l2-line", options.config.line_bytes,
+                 "L2 line size in bytes")
+      ->default_val(64);
+  app.add_option("--l2-repl", options.config.replacement,
+                 "L2 replacement policy: lru, fifo or random")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, SimDevices::L2Replacement>{
+              {"lru", SimDevices::L2Replacement::lru},
+              {"fifo", SimDevices::L2Replacement::fifo},
+              {"random", SimDevices::L2Replacement::random}},
+          CLI::ignore_case))
+      ->default_val("lru");
+  app.add_option("--l2-hit-latency", options.config.hit_latency,
+                 "L2 hit latency in cycles")
+      ->default_val(12);
+  app.add_option("--l2-miss-penalty", options.config.miss_penalty,
+                 "extra cycles per L2 miss when --dram is off")
+      ->default_val(0);
+}
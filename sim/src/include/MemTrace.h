@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace SimDevices {
+
+enum class MemTraceOp : uint8_t {
+  read = 0,        // mem_port read, data is what the device returned
+  write = 1,       // mem_port write
+  burst_read = 2,  // DPI-C line read
+  burst_write = 3, // DPI-C line write
+};
+
+struct MemTraceRecord {
+  static constexpr size_t max_beats = 8;
+
+  uint64_t cycle = 0;
+  MemTraceOp op = MemTraceOp::read;
+  uint8_t beats = 1;
+  uint64_t addr = 0;
+  // one byte per beat, writes only
+  uint64_t strb = 0;
+  std::array<uint64_t, max_beats> data{};
+
+  [[nodiscard]] bool is_write() const {
+    return op == MemTraceOp::write || op == MemTraceOp::burst_write;
+  }
+  [[nodiscard]] bool is_burst() const {
+    return op == MemTraceOp::burst_read || op == MemTraceOp::burst_write;
+  }
+};
+
+/**
+ * @brief Compact binary trace of the memory traffic, written by the simulator
+ * with --mem-trace and read back by MemReplay.
+ *
+ * The file starts with an 8-byte magic, then one record after another:
+ *   u8      op | (beats - 1) << 2
+ *   varint  zigzag(cycle - previous cycle)
+ *   varint  zigzag(addr - previous addr)
+ *   u8[]    strobe, one byte per beat, writes only
+ *   u64[]   data, one per beat, little-endian
+ * Cycles are not strictly increasing: mem_port requests are recorded one
+ * cycle late, once their read data is known.
+ */
+class MemTraceWriter {
+  std::ofstream file;
+  std::vector<uint8_t> buf;
+  const uint64_t *cycle;
+  uint64_t prev_cycle = 0;
+  uint64_t prev_addr = 0;
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+
+  void put_varint(uint64_t value);
+  void flush();
+
+public:
+  /**
+   * @param cycle read whenever a request is recorded, usually
+   * SimBase::cycle_num
+   */
+  MemTraceWriter(const std::string &path, const uint64_t *cycle);
+  MemTraceWriter(const MemTraceWriter &) = delete;
+  MemTraceWriter &operator=(const MemTraceWriter &) = delete;
+  ~MemTraceWriter();
+
+  [[nodiscard]] uint64_t now() const { return *cycle; }
+
+  void record(uint64_t cycle, MemTraceOp op, uint64_t addr, uint8_t beats,
+              uint64_t strb, const uint64_t *data);
+
+  void close();
+
+  [[nodiscard]] uint64_t get_records() const { return records; }
+  [[nodiscard]] uint64_t get_bytes() const { return bytes; }
+};
+
+class MemTraceReader {
+  std::ifstream file;
+  std::vector<uint8_t> buf;
+  size_t pos = 0;
+  size_t end = 0;
+  bool valid = false;
+  bool truncated = false;
+  uint64_t prev_cycle = 0;
+  uint64_t prev_addr = 0;
+
+  // at least one whole record in buf unless the file ends first
+  void refill();
+  bool get_varint(uint64_t &value);
+
+public:
+  explicit MemTraceReader(const std::string &path);
+
+  // the file exists and starts with the trace magic
+  [[nodiscard]] bool is_open() const { return valid; }
+
+  // the last next() hit the end of the file in the middle of a record
+  [[nodiscard]] bool is_truncated() const { return truncated; }
+
+  bool next(MemTraceRecord &record);
+};
+} // namespace SimDevices
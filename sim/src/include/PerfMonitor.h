@@ -14,6 +14,9 @@ class PerfMonitor {
   std::vector<CounterInfo> perf_counters = {};
 
 public:
+  // {hit, total} of every counter, in registration order
+  using Snapshot = std::vector<std::pair<uint64_t, uint64_t>>;
+
   PerfMonitor();
   ~PerfMonitor();
 
@@ -21,4 +24,6 @@ public:
   // pair.second: total
   void add_perf_counter(CounterInfo perf_counter);
   void print_perf_counter(bool use_log) const;
+  [[nodiscard]] Snapshot snapshot() const;
+  void print_perf_snapshot(const Snapshot &snap, bool use_log) const;
 };
@@ -1,8 +1,17 @@
 #pragma once
 
+#include "ArchState.h"
+#include "AsyncTask.h"
+#include "CommitRecord.h"
+#include "TaskScheduler.h"
 #include "TaskStruct.h"
 #include "Vtop.h"
+#include "VtopBindings.h"
+#include "async_simple/executors/SimpleExecutor.h"
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #if VM_TRACE_FST == 1
 
 #include "verilated_fst_c.h"
@@ -12,21 +21,50 @@
 class SimBase {
 public:
   enum SimState_t { sim_run, sim_stop, sim_abort, sim_finish };
+  enum StopReason { stop_finish, stop_abort, stop_max_cycles, stop_user };
+  using StopPredicate = std::function<bool()>;
 
 private:
+  // declared first so it outlives every async task that uses it
+  std::unique_ptr<async_simple::executors::SimpleExecutor> async_executor;
+  std::vector<std::function<void()>> async_drain_funcs;
+
   bool wave_trace_flag = false;
-  bool enable_corotinue_task = false;
 
 #if VM_TRACE_FST == 1
   VerilatedFstC *tfp = nullptr;
   uint64_t wave_stime = 0;
 #endif
-  std::vector<SimTask_t> after_clk_rise_tasks;
-  std::vector<SimTask_t> before_clk_rise_tasks;
+  TaskScheduler after_clk_rise_tasks;
+  TaskScheduler before_clk_rise_tasks;
   std::vector<SimTask_t> once_time_tasks;
+  // called at the end of every run(), e.g. to wait for checkers running
+  // behind the sim thread
+  std::vector<SimTask_t> run_end_tasks;
+  std::vector<CommitListener_t> commit_listeners;
+  CommitRecord commit_record;
 
   SimState_t sim_state = sim_stop;
 
+  // io_difftest ports, filled once in the constructor from the tables
+  // generated out of Vtop.h (VtopBindings.h)
+  std::array<VtopBindings::InstInfoPorts, VtopBindings::commit_width>
+      inst_info_ports{};
+  std::array<const uint64_t *, VtopBindings::gpr_num> gpr_ports{};
+  decltype(VtopBindings::csr_ports(nullptr)) all_csr_ports{};
+  // in ArchState order
+  std::array<const uint64_t *, diff_csr_addrs.size()> csr_ports{};
+
+  void init_arch_state_ports();
+  const uint64_t *csr_port(int addr) const;
+
+  // run() only evaluates the stop predicate once every this many cycles
+  static constexpr uint64_t predicate_check_interval = 1024;
+
+  StopReason stop_reason_from_state() const;
+
+  void decode_commit();
+
 public:
   std::shared_ptr<Vtop> top;
   uint64_t commit_num = 0;
@@ -36,11 +74,16 @@ public:
   SimBase();
 
   void enable_wave_trace(const std::string &file_name, uint64_t wave_stime);
-  void enable_corotinue();
+  void enable_corotinue(size_t threads);
 
   void dump_wave() const;
 
   void step();
+  void step_cycle();
+
+  StopReason run(uint64_t n_cycles, const StopPredicate &stop_predicate = {});
+  StopReason run_until(const StopPredicate &stop_predicate);
+  static std::string_view stop_reason_str(StopReason reason);
 
   void reset();
   void prepare();
@@ -53,15 +96,50 @@ public:
 
   uint64_t get_pc() const;
 
-  uint64_t get_reg(int idx);
+  uint64_t get_reg(int idx) const;
+
+  uint64_t get_csr(int idx) const;
 
-  uint64_t get_csr(int idx);
+  void read_arch_state(ArchState &state) const;
 
   bool finished() const;
 
   void add_after_clk_rise_task(const SimTask_t &task);
   void add_before_clk_rise_task(const SimTask_t &task);
+  // every-cycle tasks, called without going through std::function
+  template <typename Func>
+  void add_after_clk_rise_task(std::string name, Func func) {
+    after_clk_rise_tasks.add_task(std::move(name), std::move(func));
+  }
+  template <typename Func>
+  void add_before_clk_rise_task(std::string name, Func func) {
+    before_clk_rise_tasks.add_task(std::move(name), std::move(func));
+  }
   void add_once_time_task(const SimTask_t &task);
+  void add_run_end_task(const SimTask_t &task);
+  void add_commit_listener(const CommitListener_t &listener);
+
+  /**
+   * @brief Create a task whose handler runs on the async executor when
+   * enable_corotinue() was called before, or inline otherwise. The handler
+   * must only touch the snapshot it is given.
+   */
+  template <typename T>
+  std::shared_ptr<AsyncTask<T>>
+  make_async_task(std::string name, std::function<void(const T &)> handler,
+                  size_t batch_size = 1024) {
+    auto task = std::make_shared<AsyncTask<T>>(
+        std::move(name), async_executor.get(), std::move(handler), batch_size);
+    async_drain_funcs.emplace_back(
+        [weak_task = std::weak_ptr<AsyncTask<T>>(task)] {
+          if (const auto task = weak_task.lock()) {
+            task->drain();
+          }
+        });
+    return task;
+  }
+
+  void drain_async_tasks() const;
   void print_tasks() const;
 
   ~SimBase();
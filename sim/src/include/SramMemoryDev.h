@@ -1,38 +1,127 @@
 #pragma once
 
 #include "DeviceBase.h"
+#include "ImageCache.h"
 #include "elfio/elfio.hpp"
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <unordered_map>
 
 namespace SimDevices {
+
 class SynReadMemoryDev final : public DeviceBase {
-  std::vector<uint8_t> mem;
+public:
+  static constexpr uint64_t page_size = 4096;
+  // called with the aligned address and strobe of the write
+  using WriteWatchFunc = std::function<void(uint64_t addr, uint8_t wstrb)>;
+
+private:
+  // anonymous MAP_NORESERVE mapping, pages are populated on first touch
+  uint8_t *mem = nullptr;
   std::unordered_map<std::string, uint64_t> elf_symbol_map;
   uint64_t mem_addr;
   uint64_t mem_size;
   std::optional<uint64_t> to_host_addr;
 
+  // dirty page tracking for the memory difftest, off by default
+  bool page_hash_en = false;
+  // sum of Utils::word_hash() over the page, valid once the page was first written
+  std::vector<uint64_t> page_hash;
+  std::vector<uint8_t> page_hash_valid;
+  std::vector<uint8_t> page_dirty;
+  std::vector<uint64_t> dirty_pages;
+
+  void update_page_hash(uint64_t addr, uint64_t wdata, uint8_t wstrb);
+
+  // DPI bursts that did not fit in RAM
+  uint64_t bad_bursts = 0;
+  bool check_burst(uint64_t start, size_t beats);
+
+  std::optional<ImageCache> image_cache;
+
+  struct WriteWatch {
+    uint64_t start;
+    uint64_t end;
+    WriteWatchFunc func;
+  };
+  std::vector<WriteWatch> write_watches;
+
+  void fire_write_watches(uint64_t addr, uint8_t wstrb) const;
+  // a write from the core: stored, then watched
+  void port_write(uint64_t addr, uint64_t wdata, uint8_t wstrb);
+
+  bool load_cached_image(const char *file_name);
+  bool map_image(const std::string &image_path, uint64_t image_size);
   bool load_elf(const char *file_name);
   void collect_elf_symbols(ELFIO::elfio &reader);
   void load_elf_to_mem(ELFIO::elfio &reader);
 
 public:
-  explicit SynReadMemoryDev(uint64_t base_addr, uint32_t mem_size);
+  explicit SynReadMemoryDev(uint64_t base_addr, uint64_t mem_size);
+  SynReadMemoryDev(const SynReadMemoryDev &) = delete;
+  SynReadMemoryDev &operator=(const SynReadMemoryDev &) = delete;
+  void enable_image_cache(const std::string &cache_dir);
   void load_file(const char *file_name);
   void dump_signature(std::string_view signature_file_name);
   void check_to_host(const std::function<void(uint64_t)> &exit_callback);
+  /**
+   * @brief Call func in the same cycle a write from the memory port lands in
+   * [start, end). Writes made by the simulator itself do not fire.
+   */
+  void add_write_watch(uint64_t start, uint64_t end, WriteWatchFunc func);
   uint64_t read(uint64_t addr);
   void write(uint64_t addr, uint64_t wdata, uint8_t wstrb);
+  /**
+   * @brief Whole bursts of consecutive 8-byte beats, used by the DPI-C memory
+   * port. Beat i of write_burst() is written with strb[8*i+7:8*i], like a
+   * write from the memory port. A burst that is not all RAM is dropped, a
+   * read of it returns zeros.
+   */
+  void read_burst(uint64_t addr, size_t beats, uint64_t *data);
+  void write_burst(uint64_t addr, size_t beats, const uint64_t *data,
+                   uint64_t strb);
+  /**
+   * @brief Host address of guest RAM [addr, addr + len) for device DMA,
+   * nullptr unless all of it is RAM. Writes through it are made by the
+   * simulator: not hashed, not watched.
+   */
+  uint8_t *dma_ptr(uint64_t addr, uint64_t len) {
+    if (addr < mem_addr || len > mem_size || addr - mem_addr > mem_size - len)
+        [[unlikely]] {
+      return nullptr;
+    }
+    return &mem[addr - mem_addr];
+  }
   uint64_t update_outputs() override;
   void update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
                      bool write_en) override;
-  bool in_range(uint64_t addr) override;
+  bool in_range(uint64_t addr) override {
+    return addr >= mem_addr && addr < mem_addr + mem_size;
+  }
   std::optional<uint64_t> get_to_host_addr();
 
+  [[nodiscard]] uint64_t get_mem_addr() const { return mem_addr; }
+  [[nodiscard]] uint64_t get_mem_size() const { return mem_size; }
+  // host pages of guest RAM that are populated, from mincore
+  [[nodiscard]] uint64_t touched_bytes() const;
+  void print_mem_stats() const;
+
+  uint64_t hash_page(uint64_t page_addr) const;
+
+  /**
+   * @brief Keep per-page dirty bits and incrementally updated page hashes of
+   * the writes that reach memory.
+   */
+  void enable_page_hash();
+  [[nodiscard]] const std::vector<uint64_t> &get_dirty_pages() const {
+    return dirty_pages;
+  }
+  [[nodiscard]] uint64_t get_page_hash(uint64_t page_addr) const;
+  void clear_dirty_pages();
+
   std::vector<AddrInfo> get_addr_info() override;
-  ~SynReadMemoryDev() override = default;
+  ~SynReadMemoryDev() override;
 };
 } // namespace SimDevices
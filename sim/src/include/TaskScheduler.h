@@ -0,0 +1,87 @@
+#pragma once
+
+#include "TaskStruct.h"
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Next-deadline scheduler for period tasks.
+ * Tasks whose period_cycle is 0 or 1 are due on every cycle and are called
+ * through a flat list of function pointers. All other tasks live in a
+ * min-heap keyed by the cycle they are due, so a cycle without due tasks only
+ * costs one compare. On a cycle with due tasks both kinds run interleaved in
+ * registration order, as if every task were checked in turn.
+ */
+class TaskScheduler {
+  static constexpr uint64_t never = std::numeric_limits<uint64_t>::max();
+
+  struct Deadline {
+    uint64_t cycle;
+    size_t idx;
+
+    // tasks due on the same cycle keep their registration order
+    bool operator>(const Deadline &other) const {
+      return cycle != other.cycle ? cycle > other.cycle : idx > other.idx;
+    }
+  };
+
+  // the callable is owned by `callables`, call() knows its type
+  struct CycleTask {
+    void (*call)(void *);
+    void *ctx;
+    size_t order;
+  };
+
+  std::vector<CycleTask> every_cycle_tasks;
+  std::vector<std::shared_ptr<void>> callables;
+  std::vector<SimTask_t> period_tasks;
+  std::vector<size_t> period_order;
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>>
+      deadlines;
+  uint64_t next_deadline = never;
+  std::vector<size_t> due;
+
+  // all registered tasks, only used for printing
+  std::vector<SimTask_t> tasks;
+
+  void run_with_due(uint64_t cycle);
+
+public:
+  void add_task(const SimTask_t &task, uint64_t now);
+
+  /**
+   * @brief Add an every-cycle task. The callable keeps its own type and is
+   * called without going through std::function.
+   */
+  template <typename Func> void add_task(std::string name, Func func) {
+    auto callable = std::make_shared<Func>(std::move(func));
+    every_cycle_tasks.push_back(
+        {.call = [](void *ctx) { (*static_cast<Func *>(ctx))(); },
+         .ctx = callable.get(),
+         .order = tasks.size()});
+    callables.emplace_back(std::move(callable));
+    tasks.push_back(
+        {.task_func = nullptr, .name = std::move(name), .period_cycle = 0});
+  }
+
+  void run(const uint64_t cycle) {
+    if (cycle >= next_deadline) [[unlikely]] {
+      run_with_due(cycle);
+      return;
+    }
+    for (const auto &task : every_cycle_tasks) {
+      task.call(task.ctx);
+    }
+  }
+
+  [[nodiscard]] bool empty() const { return tasks.empty(); }
+
+  [[nodiscard]] const std::vector<SimTask_t> &get_tasks() const {
+    return tasks;
+  }
+};
@@ -1,6 +1,8 @@
 #pragma once
 
-#include "async_simple/coro/Lazy.h"
+#include <cstdint>
+#include <functional>
+#include <string>
 
 enum class SimTaskType { once, period };
 
@@ -19,18 +21,4 @@ struct SimTask_t {
       task_func();
     }
   }
-
-  async_simple::coro::Lazy<void> task_func_co_wrapper() {
-    task_func();
-    co_return;
-  }
-
-  async_simple::coro::Lazy<void> run_co() {
-    counter += 1;
-    if (counter >= period_cycle) {
-      counter = 0;
-      co_await task_func_co_wrapper();
-    }
-    co_return;
-  }
 };
\ No newline at end of file
@@ -12,7 +12,43 @@ namespace Utils {
     assert(0);                                                                 \
   }
 
-bool check_aligned(uint64_t addr, uint64_t size);
+// for checks on the per-access device path, compiled out with NDEBUG
+#ifdef NDEBUG
+#define DEBUG_ASSERT(expr, ...)                                                \
+  do {                                                                         \
+  } while (0)
+#else
+#define DEBUG_ASSERT(expr, ...)                                                \
+  do {                                                                         \
+    MY_ASSERT(expr, __VA_ARGS__)                                               \
+  } while (0)
+#endif
 
-uint64_t aligned_addr(uint64_t addr);
+inline bool check_aligned(const uint64_t addr, const uint64_t size) {
+  return (addr & (size - 1)) == 0;
+}
+
+// 8 bytes aligned
+inline uint64_t aligned_addr(const uint64_t addr) { return addr & ~0x7; }
+
+// expand a byte strobe to a 64 bit mask
+inline uint64_t strb_to_mask(const uint8_t wstrb) {
+  uint64_t mask = 0;
+  for (int i = 0; i < 8; i++) {
+    if (wstrb & 1 << i) {
+      mask |= 0xffULL << (i * 8);
+    }
+  }
+  return mask;
+}
+
+// hash of one aligned 8-byte word, memory and framebuffer hashes are sums of
+// these. splitmix64 finalizer, the address keeps equal words on different
+// offsets from cancelling out
+inline uint64_t word_hash(const uint64_t addr, const uint64_t value) {
+  uint64_t x = value ^ addr * 0x9e3779b97f4a7c15ULL;
+  x = (x ^ x >> 30) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ x >> 27) * 0x94d049bb133111ebULL;
+  return x ^ x >> 31;
+}
 } // namespace Utils
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "CoDeviceBase.h"
+#include "SramMemoryDev.h"
+#include <span>
+#include <string>
+
+namespace SimDevices {
+
+enum class VirtioBlkMode {
+  cow,    // guest writes stay in this process, the image is untouched
+  shared, // guest writes go to the image file
+  ro,     // read-only disk
+};
+
+/**
+ * @brief virtio-mmio (version 2) block device with one split virtqueue,
+ * backed by an mmap'ed disk image.
+ *
+ * Each descriptor chain is one request, its data segments are copied straight
+ * between the image mapping and guest RAM (SynReadMemoryDev::dma_ptr),
+ * without a bounce buffer. A write to QueueNotify wakes the queue model on
+ * the DeviceMange scheduler, which completes the available requests one
+ * every request_cycles and raises the interrupt once the queue is drained;
+ * irq() is the level routed to the PLIC. Without a scheduler the queue is
+ * drained inside the QueueNotify write.
+ *
+ * DMA is not coherent with the core's write-back DCache: the device reads and
+ * writes RAM behind it. The SoC maps [dma_addr, dma_addr + dma_size) uncached
+ * (the mmio flag of MiniFishSocConfig.addr_map), and the virtqueue and every
+ * buffer must live there. The device offers VIRTIO_F_ACCESS_PLATFORM and
+ * refuses FEATURES_OK without it, so the driver goes through the DMA API; in
+ * the device tree the window is a restricted-dma-pool the device points to:
+ *
+ *   reserved-memory { virtio_dma: dma@87c00000 {
+ *       compatible = "restricted-dma-pool"; reg = <0x0 0x87c00000 0x0 0x400000>;
+ *   }; };
+ *   virtio@a0001000 { compatible = "virtio,mmio"; memory-region = <&virtio_dma>;
+ *       ... };
+ *
+ * Linux then allocates the rings from the pool and bounces the data through
+ * it. Accesses outside the window fail the request with VIRTIO_BLK_S_IOERR.
+ * No AMOs in the window, they are not routed around the DCache.
+ */
+class VirtioBlkDev final : public CoDeviceBase {
+public:
+  static constexpr uint64_t sector_size = 512;
+  static constexpr uint32_t queue_size = 128;
+
+private:
+  // guest buffer of a descriptor chain, already translated to host memory
+  struct Segment {
+    uint8_t *host;
+    uint32_t len;
+  };
+
+  uint64_t mem_addr;
+  static constexpr uint64_t mem_size = 0x1000;
+  SynReadMemoryDev &ram;
+  // the uncached RAM window all DMA must stay in
+  uint64_t dma_addr;
+  uint64_t dma_size;
+
+  uint8_t *disk = nullptr;
+  uint64_t disk_size = 0;
+  VirtioBlkMode mode;
+  // completion latency of one request, 0 completes on the next cycle
+  uint64_t request_cycles;
+  DeviceEvent notify_event;
+
+  // virtio-mmio registers
+  uint32_t device_features_sel = 0;
+  uint32_t driver_features_sel = 0;
+  uint64_t driver_features = 0;
+  uint32_t queue_sel = 0;
+  uint32_t queue_num = 0;
+  uint32_t queue_ready = 0;
+  uint32_t status = 0;
+  uint32_t interrupt_status = 0;
+  uint64_t desc_addr = 0;
+  uint64_t avail_addr = 0;
+  uint64_t used_addr = 0;
+  uint16_t last_avail = 0;
+
+  uint64_t requests = 0;
+  uint64_t batches = 0;
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  uint64_t errors = 0;
+  uint64_t dma_faults = 0;
+
+  [[nodiscard]] uint64_t device_features() const;
+  // guest RAM for a DMA access, nullptr outside the DMA window
+  uint8_t *dma_ptr(uint64_t addr, uint64_t len);
+  uint32_t read_reg(uint64_t offset) const;
+  void write_reg(uint64_t offset, uint32_t value);
+  void reset();
+
+  [[nodiscard]] bool has_avail();
+  // complete the next available request, has_avail() must be true
+  void complete_next();
+  // used buffer notification, once the queue is drained
+  void end_batch();
+  void process_queue();
+  async_simple::coro::Lazy<void> queue_model();
+  // status byte of the request, used_len: bytes written into guest buffers
+  uint8_t process_chain(uint16_t head, uint32_t &used_len);
+  uint8_t do_request(std::span<const Segment> readable,
+                     std::span<const Segment> writable, uint32_t &used_len);
+
+protected:
+  void start_models() override;
+
+public:
+  VirtioBlkDev(uint64_t base_addr, SynReadMemoryDev &ram, uint64_t dma_addr,
+               uint64_t dma_size, const std::string &image,
+               VirtioBlkMode mode, uint64_t request_cycles = 0);
+  VirtioBlkDev(const VirtioBlkDev &) = delete;
+  VirtioBlkDev &operator=(const VirtioBlkDev &) = delete;
+  ~VirtioBlkDev() override;
+
+  [[nodiscard]] bool irq() const { return interrupt_status != 0; }
+
+  void update_inputs(uint64_t read_addr, bool read_en, WriteReq write_req,
+                     bool write_en) override;
+
+  uint64_t update_outputs() override;
+
+  bool in_range(uint64_t addr) override {
+    return addr >= mem_addr && addr < mem_addr + mem_size;
+  }
+
+  std::vector<AddrInfo> get_addr_info() override;
+
+  void print_stats() const;
+};
+} // namespace SimDevices
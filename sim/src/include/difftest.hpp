@@ -1,14 +1,21 @@
 #pragma once
 
+#include "ArchState.h"
+#include "AsyncTask.h"
+#include "CommitRecord.h"
+#include "InstDecode.h"
 #include "CSREncode.h"
 #include "Utils.h"
 #include "spdlog/spdlog.h"
 #include <cstdarg>
 #include <cstdint>
 #include <cstdio>
+#include <array>
 #include <format>
+#include <memory>
 #include <ranges>
-#include <vector>
+#include <string>
+#include <unordered_map>
 
 struct Rv64emuBridge {
   void *sim;
@@ -40,12 +47,98 @@ void set_reg(Rv64emuBridge *rv64emu, uintptr_t idx, uint64_t val);
 uint64_t get_csr(Rv64emuBridge *rv64emu, uint64_t addr);
 
 void set_csr(Rv64emuBridge *rv64emu, uint64_t addr, uint64_t val);
+
+// not exported by every rv64emu build, checked at runtime
+__attribute__((weak)) bool read_mem(Rv64emuBridge *rv64emu, uint64_t addr,
+                                    uint8_t *buf, uintptr_t len);
 } // extern "C"
 
+enum class DiffMode { sync, pipeline, batch };
+
+// full: compare all GPRs and CSRs on every commit
+// incremental: only after commits that can change CSRs, otherwise pc and the
+// destination GPRs
+enum class DiffCsrCheck { full, incremental };
+
+// how the reference is resynced on MMIO and csr_skip commits
+// full: write pc and all 32 GPRs
+// dest: write pc and the destination GPRs of the committed insts
+enum class DiffSkipMode { full, dest };
+
+/**
+ * @brief Self-contained copy of one DUT commit, enough for the reference to
+ * step and compare without touching the model again.
+ */
+struct DiffCommit {
+  uint64_t seq = 0;
+  uint64_t cycle = 0;
+  uint64_t next_pc = 0;
+  uint64_t cause = 0;
+  uint8_t commit_num = 0;
+  bool has_exception = false;
+  bool has_interrupt = false;
+  bool has_mmio = false;
+  bool csr_skip = false;
+  // set when a committed inst may change CSRs (csr op, trap, xret, sfence)
+  bool full_check = true;
+  std::array<uint8_t, CommitRecord::max_commit_width> dest_gpr{};
+  std::array<CommitInstInfo, CommitRecord::max_commit_width> inst_info{};
+  CommitStore store{};
+  ArchState state{};
+};
+
+// fold one commit into a rolling hash, order sensitive
+inline uint64_t diff_roll_hash(const uint64_t roll, const uint64_t hash) {
+  return (roll << 5 | roll >> 59) ^ hash;
+}
+
 class DiffTest {
+public:
+  // one diff_trace line; the optional register dump is formatted by whoever
+  // prints the entry, so it can be done off the sim thread
+  struct TraceEntry {
+    std::string message;
+    bool has_gprs = false;
+    std::array<uint64_t, 32> ref_gpr{};
+    std::array<uint64_t, 32> dut_gpr{};
+  };
+
+private:
   std::shared_ptr<spdlog::logger> logger;
   std::shared_ptr<spdlog::logger> diff_trace;
   Rv64emuBridge *rv64emu_ref;
+  uint64_t boot_pc;
+  uintptr_t memory_size;
+  uintptr_t memory_base;
+  std::string image_name;
+  // scratch for check_state, avoids a copy per commit
+  ArchState ref_state{};
+  DiffCsrCheck csr_check = DiffCsrCheck::full;
+  uint64_t full_check_num = 0;
+  uint64_t dest_check_num = 0;
+  // compare committed stores with the reference memory, needs read_mem
+  bool store_check = false;
+  uint64_t store_check_num = 0;
+
+  DiffSkipMode skip_mode = DiffSkipMode::full;
+  // MMIO skips per 4 KiB page of the accessed address
+  std::unordered_map<uint64_t, uint64_t> mmio_skip_pages;
+  uint64_t mmio_skip_unknown_num = 0;
+  uint64_t csr_skip_num = 0;
+
+  void count_skip(const DiffCommit &commit);
+
+  bool check_dest_gprs(const DiffCommit &commit);
+  bool trace_en = false;
+  std::shared_ptr<AsyncTask<TraceEntry>> trace_task;
+
+  void post_trace(const TraceEntry &entry) const {
+    if (trace_task) {
+      trace_task->post(entry);
+    } else {
+      print_trace(entry);
+    }
+  }
 
   static std::string_view get_gpr_name(const uint64_t addr) {
     constexpr std::array<std::string_view, 32> reg_names{
@@ -98,10 +191,17 @@ class DiffTest {
 public:
   DiffTest(uint64_t boot_pc, uintptr_t memory_size, uintptr_t memory_base);
 
-  void load_file(const char *file_name) const {
+  void load_file(const char *file_name) {
+    image_name = file_name;
     ::load_file(rv64emu_ref, file_name);
   }
 
+  // recreate the reference at boot_pc with the loaded image
+  void reset();
+
+  // read the compared state of the reference
+  void get_state(ArchState &state);
+
   void raise_intr(const uint64_t irq_num) const {
     ::raise_intr(rv64emu_ref, irq_num);
   }
@@ -129,27 +229,79 @@ public:
     ::set_csr(rv64emu_ref, idx, val);
   }
 
-  using read_gpr_fuc = std::function<uint64_t(size_t idx)>;
-  using read_csr_fuc = std::function<uint64_t(size_t idx)>;
+  [[nodiscard]] static bool has_read_mem() { return ::read_mem != nullptr; }
 
-  bool check_gprs(const read_gpr_fuc &dut_gpr,
-                  const read_gpr_fuc &ref_gpr) const;
+  bool read_mem(const uint64_t addr, uint8_t *buf, const uintptr_t len) const {
+    return has_read_mem() && ::read_mem(rv64emu_ref, addr, buf, len);
+  }
 
-  bool check_csrs(const read_csr_fuc &dut_csr);
+  [[nodiscard]] bool trace_enabled() const { return trace_en; }
 
-  bool check_pc(uint64_t ref_pc, uint64_t dut_pc) const;
+  void set_csr_check(const DiffCsrCheck check) { csr_check = check; }
 
-  void ref_skip(const read_gpr_fuc &dut_gpr, uint64_t dut_pc) const;
+  void set_skip_mode(const DiffSkipMode mode) { skip_mode = mode; }
+
+  void set_store_check(const bool en) { store_check = en; }
+
+  // resync the reference over a MMIO or csr_skip commit
+  void skip(const DiffCommit &commit) const;
+
+  /**
+   * @brief Print the skip counters, name_of maps an address to the device
+   * that owns it.
+   */
+  void print_skip_stats(
+      const std::function<std::string(uint64_t)> &name_of) const;
+
+  // route diff_trace output through an async task, keeping its order
+  void set_trace_task(std::shared_ptr<AsyncTask<TraceEntry>> task) {
+    trace_task = std::move(task);
+  }
+
+  template <typename... Args>
+  void trace(std::format_string<Args...> fmt, Args &&...args) const {
+    if (trace_en) {
+      post_trace({.message = std::format(fmt, std::forward<Args>(args)...)});
+    }
+  }
+
+  void print_trace(const TraceEntry &entry) const;
+
+  void report_mismatch(const ArchState &ref, const ArchState &dut) const;
+
+  void ref_skip(const std::array<uint64_t, 32> &dut_gpr, uint64_t dut_pc) const;
 
   void raise_int(uint64_t irq_num) const;
 
+  bool check_commit(const DiffCommit &commit);
+
+  /**
+   * @brief Compare the reference with a commit, without stepping.
+   * @param full compare the whole ArchState even if commit.full_check is not
+   * set; needed by callers that did not check every commit before, e.g. at a
+   * batch boundary, where a divergence can be in any register
+   * @return true on mismatch
+   */
+  bool check_state(const DiffCommit &commit, bool full = false);
+
+  /**
+   * @brief Compare the bytes written by the committed store with the
+   * reference memory. The store is taken when it commits, so dirty lines in
+   * the write-back DCache do not matter; call it right after the reference
+   * stepped over the commit, before a younger store can overwrite it.
+   * @return true on mismatch
+   */
+  bool check_store(const DiffCommit &commit);
+
   ~DiffTest();
 };
 
 inline DiffTest::DiffTest(const uint64_t boot_pc, const uintptr_t memory_size,
-                          const uintptr_t memory_base) {
+                          const uintptr_t memory_base)
+    : boot_pc(boot_pc), memory_size(memory_size), memory_base(memory_base) {
   logger = spdlog::get("console");
   diff_trace = spdlog::get("diff_trace");
+  trace_en = diff_trace->level() != spdlog::level::off;
   rv64emu_ref = create_rv64emu("rv64imac", "sv39", boot_pc, memory_size,
                                memory_base, 0, true, true, false);
   logger->info("Create rv64emu_ref with isa {}, mmu {}, smode {} umode {} "
@@ -161,94 +313,255 @@ inline DiffTest::DiffTest(const uint64_t boot_pc, const uintptr_t memory_size,
   logger->info("DiffTest init finished");
 }
 
-inline DiffTest::~DiffTest() { destroy_rv64emu(rv64emu_ref); }
+inline void DiffTest::reset() {
+  destroy_rv64emu(rv64emu_ref);
+  rv64emu_ref = create_rv64emu("rv64imac", "sv39", boot_pc, memory_size,
+                               memory_base, 0, true, true, false);
+  if (!image_name.empty()) {
+    ::load_file(rv64emu_ref, image_name.c_str());
+  }
+}
 
-inline bool DiffTest::check_gprs(const read_gpr_fuc &dut_gpr,
-                                 const read_gpr_fuc &ref_gpr) const {
-  auto log_registers = [&](const std::string &name, const read_gpr_fuc &gpr) {
+inline void DiffTest::get_state(ArchState &state) {
+  state.pc = get_pc();
+  for (size_t idx = 0; idx < state.gpr.size(); idx++) {
+    state.gpr[idx] = get_reg(idx);
+  }
+  for (size_t idx = 0; idx < diff_csr_addrs.size(); idx++) {
+    state.csr[idx] = get_csr(diff_csr_addrs[idx]);
+  }
+}
+
+inline DiffTest::~DiffTest() {
+  logger->info("DiffTest checks: {} full, {} destination GPR only",
+               full_check_num, dest_check_num);
+  if (store_check) {
+    logger->info("DiffTest store checks: {}", store_check_num);
+  }
+  if (trace_task) {
+    trace_task->drain();
+  }
+  destroy_rv64emu(rv64emu_ref);
+}
+
+inline void DiffTest::print_trace(const TraceEntry &entry) const {
+  if (!entry.has_gprs) {
+    diff_trace->info(entry.message);
+    return;
+  }
+
+  auto log_registers = [&](const std::string &name,
+                           const std::array<uint64_t, 32> &gpr) {
     std::string log_message;
     for (const int idx : std::views::iota(0, 8)) {
       log_message += std::format(
           "{} reg: x{:02d}: 0x{:016x} x{:02d}: 0x{:016x} x{:02d}: "
           "0x{:016x} x{:02d}: 0x{:016x}",
-          name, idx * 4, gpr(idx * 4), idx * 4 + 1, gpr(idx * 4 + 1),
-          idx * 4 + 2, gpr(idx * 4 + 2), idx * 4 + 3, gpr(idx * 4 + 3));
+          name, idx * 4, gpr[idx * 4], idx * 4 + 1, gpr[idx * 4 + 1],
+          idx * 4 + 2, gpr[idx * 4 + 2], idx * 4 + 3, gpr[idx * 4 + 3]);
     }
     diff_trace->info(log_message);
   };
 
-  // if logger is not set skip
-  if (diff_trace->level() != spdlog::level::off) {
-    log_registers("ref", ref_gpr);
-    diff_trace->info("");
-    log_registers("dut", dut_gpr);
-  }
+  log_registers("ref", entry.ref_gpr);
+  diff_trace->info("");
+  log_registers("dut", entry.dut_gpr);
+}
 
-  auto compare_and_log = [&](int idx, uint64_t ref_val, uint64_t dut_val) {
-    if (ref_val != dut_val) {
+inline void DiffTest::report_mismatch(const ArchState &ref,
+                                      const ArchState &dut) const {
+  if (ref.pc != dut.pc) {
+    logger->critical("pc mismatch: ref value: 0x{:016x}, dut value: 0x{:016x}",
+                     ref.pc, dut.pc);
+  }
+  for (size_t idx = 0; idx < ref.gpr.size(); idx++) {
+    if (ref.gpr[idx] != dut.gpr[idx]) {
       logger->critical(
           " GPR {}({}) mismatch: ref value: 0x{:016x}, dut value: 0x{:016x}",
-          idx, get_gpr_name(idx), ref_val, dut_val);
-      return true;
+          idx, get_gpr_name(idx), ref.gpr[idx], dut.gpr[idx]);
     }
-    return false;
-  };
+  }
+  for (size_t idx = 0; idx < diff_csr_addrs.size(); idx++) {
+    if (ref.csr[idx] != dut.csr[idx]) {
+      logger->info("csr {:04x},{:s} mismatch, ref value: 0x{:016x}, dut value: "
+                   "0x{:016x}",
+                   diff_csr_addrs[idx], get_csr_name(diff_csr_addrs[idx]),
+                   ref.csr[idx], dut.csr[idx]);
+    }
+  }
+}
 
-  bool fail = false;
-  for (const int idx : std::views::iota(0, 32)) {
-    fail |= compare_and_log(idx, ref_gpr(idx), dut_gpr(idx));
+inline void DiffTest::ref_skip(const std::array<uint64_t, 32> &dut_gpr,
+                               const uint64_t dut_pc) const {
+  set_pc(dut_pc);
+  for (size_t idx = 0; idx < dut_gpr.size(); idx++) {
+    set_reg(idx, dut_gpr[idx]);
   }
+}
 
-  return fail;
+inline void DiffTest::skip(const DiffCommit &commit) const {
+  if (skip_mode == DiffSkipMode::full) {
+    ref_skip(commit.state.gpr, commit.next_pc);
+    return;
+  }
+  set_pc(commit.next_pc);
+  for (size_t idx = 0; idx < commit.commit_num; idx++) {
+    if (const auto rd = commit.dest_gpr[idx]; rd != 0) {
+      set_reg(rd, commit.state.gpr[rd]);
+    }
+  }
 }
 
-inline bool DiffTest::check_pc(uint64_t ref_pc, uint64_t dut_pc) const {
-  bool fail = false;
+inline void DiffTest::count_skip(const DiffCommit &commit) {
+  if (!commit.has_mmio) {
+    csr_skip_num++;
+    return;
+  }
+  // the reference has not run the commit yet, so rs1 still holds the base
+  for (size_t idx = 0; idx < commit.commit_num; idx++) {
+    const auto &info = commit.inst_info[idx];
+    uint8_t rs1;
+    int64_t imm;
+    if (inst_mem_operand(info.inst, info.is_rvc, rs1, imm)) {
+      const uint64_t addr = get_reg(rs1) + imm;
+      mmio_skip_pages[addr & ~0xfffULL]++;
+      return;
+    }
+  }
+  mmio_skip_unknown_num++;
+}
 
-  diff_trace->info("ref pc: 0x{:016x}, dut pc: 0x{:016x}", ref_pc, dut_pc);
+inline void DiffTest::print_skip_stats(
+    const std::function<std::string(uint64_t)> &name_of) const {
+  std::unordered_map<std::string, uint64_t> per_device;
+  for (const auto &[page, count] : mmio_skip_pages) {
+    per_device[name_of(page)] += count;
+  }
 
-  if (ref_pc != dut_pc) {
-    logger->critical("pc mismatch: ref value: 0x{:016x}, dut value: 0x{:016x}",
-                     ref_pc, dut_pc);
-    fail = true;
+  logger->info("DiffTest skips: {} csr, {} mmio with unknown address",
+               csr_skip_num, mmio_skip_unknown_num);
+  for (const auto &[name, count] : per_device) {
+    logger->info("DiffTest mmio skips: {:<20} {}", name, count);
   }
-  return fail;
 }
 
-inline bool DiffTest::check_csrs(const read_csr_fuc &dut_csr) {
-  constexpr auto need_csr =
-      std::array{MISA,    MCAUSE,  MEPC, MTVEC, MSTATUS, MIE,   MTVAL,
-                 MEDELEG, MIDELEG, SEPC, STVEC, SCAUSE,  STVAL, SATP};
-  auto ref_csrs = std::vector<uint64_t>();
-  auto dut_csrs = std::vector<uint64_t>();
+inline void DiffTest::raise_int(const uint64_t irq_num) const {
+  raise_intr(irq_num);
+}
 
-  for (const auto csr_addr : need_csr) {
-    ref_csrs.emplace_back(get_csr(csr_addr));
-    dut_csrs.emplace_back(dut_csr(csr_addr));
+/**
+ * @brief Step the reference over one DUT commit and compare pc, GPRs and CSRs.
+ * @return true on mismatch
+ */
+inline bool DiffTest::check_commit(const DiffCommit &commit) {
+  const auto pc = commit.state.pc;
+  const auto next_pc = commit.next_pc;
+  bool mismatch = false;
+
+  if (commit.has_interrupt + commit.has_exception + commit.has_mmio +
+          commit.csr_skip >
+      1) {
+    logger->critical("exception and interrupt and mmio at the same time");
+    logger->critical("has_interrupt: {}, has_exception: {}, has_mmio: {}, "
+                     "has_csr_skip: {}\n",
+                     commit.has_interrupt, commit.has_exception,
+                     commit.has_mmio, commit.csr_skip);
+    mismatch = true;
   }
 
-  bool mismatch = false;
-  for (auto idx = 0; idx < need_csr.size(); idx++) {
-    if (dut_csrs[idx] != ref_csrs[idx]) {
-      mismatch = true;
-      logger->info("csr {:04x},{:s} mismatch, ref value: 0x{:016x}, dut value: "
-                   "0x{:016x}",
-                   need_csr[idx], get_csr_name(need_csr[idx]), ref_csrs[idx],
-                   dut_csrs[idx]);
-    }
+  if (commit.has_mmio || commit.csr_skip) {
+    trace("skip mmio or csr at pc: 0x{:016x},next pc: 0x{:016x}", pc, next_pc);
+    count_skip(commit);
+    skip(commit);
+    return mismatch;
+  }
+
+  step(commit.commit_num);
+  trace("Commit {} inst at pc: 0x{:016x},next pc: 0x{:016x}",
+        commit.commit_num, pc, next_pc);
+
+  if (commit.has_interrupt) {
+    trace("has_interrupt at pc: 0x{:016x},cause: 0x{:8x}", pc, commit.cause);
+    raise_intr(commit.cause & 0xffff);
   }
 
+  mismatch |= check_state(commit);
+  if (store_check && commit.store.valid) {
+    mismatch |= check_store(commit);
+  }
+  trace("--------------------End DiffTest at pc: "
+        "0x{:016x}----------------------\n",
+        pc);
   return mismatch;
 }
 
-inline void DiffTest::ref_skip(const read_gpr_fuc &dut_gpr,
-                               const uint64_t dut_pc) const {
-  set_pc(dut_pc);
-  for (const int idx : std::views::iota(0, 32)) {
-    set_reg(idx, dut_gpr(idx));
+inline bool DiffTest::check_dest_gprs(const DiffCommit &commit) {
+  const auto &dut_state = commit.state;
+  const auto ref_pc = get_pc();
+  bool mismatch = ref_pc != dut_state.pc;
+  for (size_t idx = 0; idx < commit.commit_num; idx++) {
+    const auto rd = commit.dest_gpr[idx];
+    mismatch |= get_reg(rd) != dut_state.gpr[rd];
   }
+
+  if (trace_en) {
+    trace("ref pc: 0x{:016x}, dut pc: 0x{:016x}", ref_pc, dut_state.pc);
+  }
+  return mismatch;
 }
 
-inline void DiffTest::raise_int(const uint64_t irq_num) const {
-  raise_intr(irq_num);
+inline bool DiffTest::check_state(const DiffCommit &commit, const bool full) {
+  const auto &dut_state = commit.state;
+  if (!full && csr_check == DiffCsrCheck::incremental && !commit.full_check) {
+    dest_check_num++;
+    if (!check_dest_gprs(commit)) [[likely]] {
+      return false;
+    }
+    // fall through for the full report
+  } else {
+    full_check_num++;
+  }
+
+  get_state(ref_state);
+
+  if (trace_en) {
+    trace("ref pc: 0x{:016x}, dut pc: 0x{:016x}", ref_state.pc, dut_state.pc);
+    post_trace({.has_gprs = true,
+                .ref_gpr = ref_state.gpr,
+                .dut_gpr = dut_state.gpr});
+  }
+
+  if (ref_state.same_as(dut_state)) [[likely]] {
+    return false;
+  }
+
+  report_mismatch(ref_state, dut_state);
+  logger->critical("DiffTest mismatch at commit {} (cycle {})", commit.seq,
+                   commit.cycle);
+  logger->critical("pc mismatch: ref: 0x{:08x}, dut: 0x{:08x}\n\n",
+                   ref_state.pc, dut_state.pc);
+  return true;
+}
+
+inline bool DiffTest::check_store(const DiffCommit &commit) {
+  const auto &store = commit.store;
+  const auto addr = Utils::aligned_addr(store.paddr);
+  uint64_t ref_value = 0;
+  if (!read_mem(addr, reinterpret_cast<uint8_t *>(&ref_value),
+                sizeof(ref_value))) {
+    // outside the reference memory
+    return false;
+  }
+  store_check_num++;
+
+  const auto mask = Utils::strb_to_mask(store.wstrb);
+  if (((ref_value ^ store.wdata) & mask) == 0) [[likely]] {
+    return false;
+  }
+  logger->critical("DiffTest store mismatch at commit {} (cycle {})",
+                   commit.seq, commit.cycle);
+  logger->critical("store at 0x{:016x}, ref value: 0x{:016x}, dut value: "
+                   "0x{:016x}, mask: 0x{:016x}",
+                   addr, ref_value & mask, store.wdata & mask, mask);
+  return true;
 }
@@ -4,7 +4,9 @@
 #include "AMVGADev.h"
 #include "CLI/CLI.hpp"
 #include "DeviceMange.h"
+#include "DpiMemory.h"
 #include "RemoteBitBang.h"
+#include "VirtioBlkDev.h"
 #include "SimBase.h"
 #include "difftest.hpp"
 #include "include/AllTask.h"
@@ -27,6 +29,10 @@ constexpr auto RTC_ADDR = DEVICE_BASE + 0x0000048L;
 constexpr auto KBD_ADDR = DEVICE_BASE + 0x0000060L;
 constexpr auto VGACTL_ADDR = DEVICE_BASE + 0x0000100L;
 constexpr auto FB_ADDR = DEVICE_BASE + 0x1000000L;
+constexpr auto VIRTIO_BLK_ADDR = DEVICE_BASE + 0x0001000L;
+// uncached RAM for virtio DMA, same as MiniFishSocConfig.DMA_POOL_ADDR
+constexpr auto DMA_POOL_SIZE = 0x400000L;
+constexpr auto DMA_POOL_ADDR = MEM_BASE + MEM_SIZE - DMA_POOL_SIZE;
 constexpr auto BOOT_PC = 0x80000000L;
 
 static bool is_exit = false;
@@ -99,11 +105,24 @@ int main(int argc, char **argv) {
   bool difftest_log_en = false;
   bool am_en = false;
   bool vga_en = false;
+  bool vga_headless = false;
+  auto vga_capture = SimDevices::VGACaptureConfig();
   bool rbb_en = false;
   bool to_host_check_en = false;
   bool corotinue_en = false;
+  size_t async_threads = 2;
+  auto diff_options = DiffTestOptions();
+  auto dram_options = DramOptions();
+  auto l2_options = L2Options();
 
   long max_cycles = 50000;
+  uint64_t mem_size = MEM_SIZE;
+  std::string image_cache_dir;
+  std::string mem_trace_file;
+  std::string blk_image;
+  auto blk_mode = SimDevices::VirtioBlkMode::cow;
+  uint64_t uart_tx_cycles = 0;
+  uint64_t blk_latency = 1000;
   int rbb_port = 23456;
   std::optional<std::string> dump_signature_file = std::nullopt;
 
@@ -114,12 +133,69 @@ int main(int argc, char **argv) {
                  "dump signature file(for riscof)");
 
   app.add_option("--clk", max_cycles, "max cycles")->default_val(50000);
+  app.add_option("--mem-size", mem_size,
+                 "guest RAM size, must match the SoC RAM window "
+                 "(MiniFishSocConfig.mem_size, 128M)")
+      ->transform(CLI::AsSizeValue(false))
+      ->default_str("128M");
+  app.add_option("--image-cache", image_cache_dir,
+                 "convert the ELF once into a flat image in this directory "
+                 "and mmap it copy-on-write on later runs");
   app.add_flag("--am", am_en, "enable am")->default_val(false);
   app.add_flag("-w,--wave", wave_en, "enable wave trace")->default_val(false);
   app.add_option("--wave_stime", wave_stime, "start wave on N commit")
       ->default_val(0);
   app.add_flag("-d,--difftest", difftest_en, "enable difftest with rv64emu")
       ->default_val(false);
+  app.add_option("--diff-mode", diff_options.mode,
+                 "sync: check every commit on the sim thread, pipeline: check "
+                 "on a reference thread behind the DUT, batch: check at batch "
+                 "boundaries and replay the batch on mismatch")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, DiffMode>{{"sync", DiffMode::sync},
+                                          {"pipeline", DiffMode::pipeline},
+                                          {"batch", DiffMode::batch}},
+          CLI::ignore_case))
+      ->default_val("sync");
+  app.add_option("--diff-batch", diff_options.batch_size,
+                 "insts per batch in --diff-mode=batch")
+      ->default_val(4096);
+  app.add_option("--diff-replay-limit", diff_options.replay_limit,
+                 "MMIO/csr skips kept to replay a --diff-mode=batch mismatch, "
+                 "0 for no limit")
+      ->default_val(1 << 20);
+  app.add_option("--diff-csr", diff_options.csr_check,
+                 "full: compare all GPRs and CSRs on every commit, "
+                 "incremental: only after CSR ops and traps")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, DiffCsrCheck>{
+              {"full", DiffCsrCheck::full},
+              {"incremental", DiffCsrCheck::incremental}},
+          CLI::ignore_case))
+      ->default_val("incremental");
+  app.add_option("--diff-skip", diff_options.skip_mode,
+                 "resync the reference on MMIO/csr_skip commits, full: pc and "
+                 "all GPRs, dest: pc and the destination GPRs")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, DiffSkipMode>{{"full", DiffSkipMode::full},
+                                              {"dest", DiffSkipMode::dest}},
+          CLI::ignore_case))
+      ->default_val("dest");
+  app.add_flag("--diff-mem", diff_options.mem_check,
+               "check memory against the reference")
+      ->default_val(false);
+  app.add_option("--diff-mem-mode", diff_options.mem_mode,
+                 "stream: compare every committed store, page: compare dirty "
+                 "page hashes, unreliable with the write-back DCache")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, DiffMemMode>{{"stream", DiffMemMode::stream},
+                                             {"page", DiffMemMode::page}},
+          CLI::ignore_case))
+      ->default_val("stream");
+  app.add_option("--diff-mem-interval", diff_options.mem_interval,
+                 "cycles between two --diff-mem-mode=page checks")
+      ->default_val(10000)
+      ->check(CLI::PositiveNumber);
   // log options
   app.add_flag("--diff-log", difftest_log_en, "enable log")->default_val(false);
   app.add_flag("--itrace", itrace_log_en, "enable instruction trace")
@@ -127,7 +203,56 @@ int main(int argc, char **argv) {
   app.add_flag("--perf-trace", perf_trace_log_en, "enable perf trace")
       ->default_val(false);
   // device options
+  app.add_option("--uart-tx-cycles", uart_tx_cycles,
+                 "cycles the uart takes to send one character")
+      ->default_val(0);
   app.add_flag("--vga", vga_en, "enable am vga")->default_val(false);
+  app.add_flag("--vga-headless", vga_headless,
+               "enable am vga without an SDL window, for --vga-log/--vga-dump")
+      ->default_val(false);
+  app.add_option("--vga-log", vga_capture.log_file,
+                 "write the cycle and hash of every vga frame to this file");
+  app.add_option("--vga-dump", vga_capture.dump_dir,
+                 "write vga frames as PPM images to this directory");
+  app.add_option("--vga-dump-every", vga_capture.dump_every,
+                 "only dump every Nth vga frame")
+      ->default_val(1);
+  app.add_option("--blk", blk_image,
+                 "disk image for the virtio-blk device, e.g. a rootfs");
+  app.add_option("--blk-mode", blk_mode,
+                 "cow: guest writes are not saved, shared: guest writes go "
+                 "to the image, ro: read-only disk")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, SimDevices::VirtioBlkMode>{
+              {"cow", SimDevices::VirtioBlkMode::cow},
+              {"shared", SimDevices::VirtioBlkMode::shared},
+              {"ro", SimDevices::VirtioBlkMode::ro}},
+          CLI::ignore_case))
+      ->default_val("cow");
+  app.add_option("--blk-latency", blk_latency,
+                 "cycles the virtio-blk device takes to complete one request")
+      ->default_val(1000);
+  auto dram_presets = SimDevices::DramConfig::preset_names();
+  dram_presets.insert(dram_presets.begin(), "off");
+  app.add_option("--dram", dram_options.preset,
+                 "DRAM timing model behind the DPI memory port")
+      ->transform(CLI::IsMember(dram_presets, CLI::ignore_case))
+      ->default_val("off");
+  app.add_option("--dram-banks", dram_options.banks, "override DRAM banks");
+  app.add_option("--dram-row-bytes", dram_options.row_bytes,
+                 "override DRAM row size in bytes");
+  app.add_option("--dram-tcas", dram_options.t_cas, "override DRAM tCAS");
+  app.add_option("--dram-trcd", dram_options.t_rcd, "override DRAM tRCD");
+  app.add_option("--dram-trp", dram_options.t_rp, "override DRAM tRP");
+  app.add_option("--dram-trefi", dram_options.t_refi,
+                 "override DRAM tREFI, 0 disables refresh");
+  app.add_option("--dram-trfc", dram_options.t_rfc, "override DRAM tRFC");
+  app.add_option("--dram-queue", dram_options.queue_depth,
+                 "override DRAM bursts in flight");
+  add_l2_options(app, l2_options);
+  app.add_option("--mem-trace", mem_trace_file,
+                 "record mem_port and DPI memory traffic to this file, "
+                 "replay it with MemReplay");
 
   // remote bitbang options
   app.add_flag("--rbb", rbb_en, "enable remote bitbang")->default_val(false);
@@ -137,8 +262,12 @@ int main(int argc, char **argv) {
   // tohost check
   app.add_flag("--tohost-check", to_host_check_en, "enable to_host check")
       ->default_val(false);
-  app.add_flag("-c,--corotinue", corotinue_en, "enable corotinue task")
+  app.add_flag("-c,--corotinue", corotinue_en,
+               "offload itrace/perf-trace/diff-log printing to worker threads")
       ->default_val(false);
+  app.add_option("--async-threads", async_threads,
+                 "worker threads used by --corotinue")
+      ->default_val(2);
 
   CLI11_PARSE(app, argc, argv)
 
@@ -166,6 +295,15 @@ int main(int argc, char **argv) {
   if (!itrace_log_en) {
     itrace_log->set_level(spdlog::level::off);
   }
+
+  // the RTL decodes exactly this window, a smaller buffer would let bursts
+  // past its end and a larger one is unreachable
+  if (mem_size != static_cast<uint64_t>(MEM_SIZE)) {
+    console->critical("--mem-size 0x{:x} does not match the SoC RAM window "
+                      "0x{:x} (MiniFishSocConfig.mem_size)",
+                      mem_size, MEM_SIZE);
+    return EXIT_FAILURE;
+  }
   if (!perf_trace_log_en) {
     perf_trace->set_level(spdlog::level::off);
   }
@@ -179,51 +317,91 @@ int main(int argc, char **argv) {
   // -----------------------
 
   auto sim_base = SimBase();
+  if (corotinue_en) {
+    // must be enabled before the tasks are created
+    sim_base.enable_corotinue(async_threads);
+  }
 
   // -----------------------
   // Device Manager
   // -----------------------
   auto device_manager = SimDevices::DeviceMange();
-  auto sim_mem = SimDevices::SynReadMemoryDev(MEM_BASE, MEM_SIZE);
-  auto sim_am_uart = SimDevices::AMUartDev(SERIAL_PORT);
+  auto sim_mem = SimDevices::SynReadMemoryDev(MEM_BASE, mem_size);
+  auto sim_am_uart = SimDevices::AMUartDev(SERIAL_PORT, uart_tx_cycles);
   auto sim_am_rtc = SimDevices::AMRTCDev(RTC_ADDR);
   auto sim_am_vga = std::optional<SimDevices::AMVGADev>();
   auto sim_am_kbd = std::optional<SimDevices::AMKBDDev>();
+  auto sim_virtio_blk = std::optional<SimDevices::VirtioBlkDev>();
 
   device_manager.add_device(&sim_mem);
   device_manager.add_device(&sim_am_uart);
   device_manager.add_device(&sim_am_rtc);
 
-  if (vga_en) {
+  if (vga_en || vga_headless) {
     sim_am_vga.emplace(FB_ADDR, VGACTL_ADDR);
     sim_am_kbd.emplace(KBD_ADDR);
-    sim_am_vga.value().init_screen("npc_v2_sdl");
-    sim_am_kbd.value().create_kdb_thread();
+    // headless: no window and no key events
+    if (!vga_headless) {
+      sim_am_vga.value().init_screen("npc_v2_sdl", &sim_am_kbd.value());
+    }
+    if (vga_headless || !vga_capture.log_file.empty() ||
+        !vga_capture.dump_dir.empty()) {
+      sim_am_vga.value().enable_capture(vga_capture, &sim_base.cycle_num);
+    }
     device_manager.add_device(&sim_am_kbd.value());
     device_manager.add_device(&sim_am_vga.value());
   }
+  if (!blk_image.empty()) {
+    sim_virtio_blk.emplace(VIRTIO_BLK_ADDR, sim_mem, DMA_POOL_ADDR,
+                           DMA_POOL_SIZE, blk_image, blk_mode, blk_latency);
+    device_manager.add_device(&sim_virtio_blk.value());
+  }
   device_manager.print_device_info();
+  SimDevices::bind_dpi_memory(&sim_mem);
+
+  // -----------------------
+  // DRAM timing
+  // -----------------------
+  auto dram = std::optional<SimDevices::DramModel>();
+  task_dram(sim_base, dram, dram_options);
 
-  sim_base.add_after_clk_rise_task(
-      {[&] {
-         const uint64_t rdata = device_manager.update_outputs();
-         const auto top = sim_base.top;
-         const bool device_sucess = device_manager.update_inputs(
-             top->io_mem_port_i_raddr, top->io_mem_port_i_rd,
-             {.waddr = top->io_mem_port_i_waddr,
-              .wdata = top->io_mem_port_i_wdata,
-              .wstrb = top->io_mem_port_i_wstrb},
-             top->io_mem_port_i_we);
-
-         if (!device_sucess) {
-           console->critical("device error at pc: 0x{:016x}\n",
-                             sim_base.get_pc());
-           sim_base.set_state(SimBase::sim_abort);
-         }
-
-         top->io_mem_port_o_rdata = rdata;
-       },
-       "update devices", 0});
+  // -----------------------
+  // Memory trace
+  // -----------------------
+  auto mem_trace = std::optional<SimDevices::MemTraceWriter>();
+  task_mem_trace(sim_base, mem_trace, device_manager, mem_trace_file);
+
+  sim_base.add_after_clk_rise_task("update devices", [&] {
+    const auto top = sim_base.top;
+    // main memory goes through the DPI-C port, most cycles have no
+    // MMIO access and o_rdata just holds its value
+    if (!top->io_mem_port_i_rd && !top->io_mem_port_i_we &&
+        device_manager.idle()) [[likely]] {
+      device_manager.tick();
+      // a virtio-blk request can complete on any tick
+      if (sim_virtio_blk.has_value()) {
+        top->io_virtio_irq = sim_virtio_blk->irq();
+      }
+      return;
+    }
+    const uint64_t rdata = device_manager.update_outputs();
+    const bool device_sucess = device_manager.update_inputs(
+        top->io_mem_port_i_raddr, top->io_mem_port_i_rd,
+        {.waddr = top->io_mem_port_i_waddr,
+         .wdata = top->io_mem_port_i_wdata,
+         .wstrb = top->io_mem_port_i_wstrb},
+        top->io_mem_port_i_we);
+
+    if (!device_sucess) {
+      console->critical("device error at pc: 0x{:016x}\n", sim_base.get_pc());
+      sim_base.set_state(SimBase::sim_abort);
+    }
+
+    top->io_mem_port_o_rdata = rdata;
+    if (sim_virtio_blk.has_value()) {
+      top->io_virtio_irq = sim_virtio_blk->irq();
+    }
+  });
 
   // -----------------------
   // SOC UART IO
@@ -238,6 +416,13 @@ int main(int argc, char **argv) {
   auto perf_monitor = PerfMonitor();
   task_perfmonitor(sim_base, perf_monitor, perf_trace_log_en);
 
+  // -----------------------
+  // L2 cache
+  // -----------------------
+  auto l2 = std::optional<SimDevices::L2Cache>();
+  task_l2(sim_base, l2, dram, perf_monitor, l2_options);
+  task_dpi_mem_check(sim_base, dram.has_value() || l2.has_value());
+
   // -----------------------
   // Exit Condtion Detect
   // -----------------------
@@ -250,7 +435,8 @@ int main(int argc, char **argv) {
   // Difftest
   // -----------------------
   auto diff_ref = std::optional<DiffTest>();
-  task_difftest(sim_base, diff_ref, image_name, difftest_en);
+  task_difftest(sim_base, diff_ref, sim_mem, device_manager, image_name,
+                difftest_en, diff_options);
 
   // -----------------------
   // Itrace
@@ -275,33 +461,29 @@ int main(int argc, char **argv) {
     sim_base.enable_wave_trace(wave_name, wave_stime);
     console->info("Wave init finished, File:{}", wave_name);
   }
-  if (corotinue_en) {
-    sim_base.enable_corotinue();
+  if (!image_cache_dir.empty()) {
+    sim_mem.enable_image_cache(image_cache_dir);
   }
   sim_mem.load_file(image_name.c_str());
 
-  auto start_time = std::chrono::utc_clock::now();
-
   sim_base.prepare();
   // simulator loop
-  while (!sim_base.finished() && !is_exit && sim_base.cycle_num < max_cycles) {
-    sim_base.step();
-  }
-
-  auto time_end = std::chrono::utc_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-      time_end - start_time);
+  sim_base.run(max_cycles, [] { return is_exit; });
+  // flushes whatever the device models still hold, e.g. uart tx
+  device_manager.shutdown();
 
   if (dump_signature_file.has_value()) {
     sim_mem.dump_signature(dump_signature_file.value());
   }
 
-  console->info(
-      "Simulator exit, Simulate {} cycles in {} ms, Speed {:.2f}K inst/second ",
-      sim_base.cycle_num, duration.count(),
-      static_cast<double>(sim_base.commit_num) / (duration.count() + 1));
-
   perf_monitor.print_perf_counter(true);
+  sim_mem.print_mem_stats();
+  if (sim_virtio_blk.has_value()) {
+    sim_virtio_blk->print_stats();
+  }
+  if (sim_am_vga.has_value()) {
+    sim_am_vga->print_stats();
+  }
 
   bool success = !am_en || sim_base.get_reg(10) == 0;
 
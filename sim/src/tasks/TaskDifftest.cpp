@@ -1,10 +1,9 @@
 #include "AllTask.h"
+#include "InstDecode.h"
 #include "spdlog/logger.h"
 #include <cstdio>
 #include <memory>
 
-constexpr auto MEM_BASE = 0x80000000L;
-constexpr auto MEM_SIZE = 0x8000000L;
 constexpr auto DEVICE_BASE = 0xa0000000L;
 constexpr auto SERIAL_PORT = DEVICE_BASE + 0x00003f8L;
 constexpr auto RTC_ADDR = DEVICE_BASE + 0x0000048L;
@@ -13,96 +12,190 @@ constexpr auto VGACTL_ADDR = DEVICE_BASE + 0x0000100L;
 constexpr auto FB_ADDR = DEVICE_BASE + 0x1000000L;
 constexpr auto BOOT_PC = 0x80000000L;
 
-static std::shared_ptr<spdlog::logger> diff_trace = nullptr;
 static std::shared_ptr<spdlog::logger> console = nullptr;
 
-// TODO: 有性能问题
+// commits the DUT may run ahead of the reference in pipeline mode
+constexpr size_t DIFF_PIPELINE_DEPTH = 4096;
+
+static DiffCommit make_diff_commit(const CommitRecord &rec,
+                                   const uint64_t seq) {
+  DiffCommit commit;
+  commit.seq = seq;
+  commit.cycle = rec.cycle;
+  commit.next_pc = rec.next_pc(); // for diff skip
+  commit.cause = rec.cause;
+  commit.commit_num = rec.commit_num;
+  commit.has_exception = rec.has_exception;
+  commit.has_interrupt = rec.has_interrupt;
+  commit.has_mmio = rec.has_mmio;
+  commit.csr_skip = rec.csr_skip;
+  commit.inst_info = rec.inst_info;
+  commit.store = rec.store;
+  rec.sim->read_arch_state(commit.state);
+
+  commit.full_check = rec.has_exception || rec.has_interrupt;
+  for (size_t idx = 0; idx < rec.commit_num; idx++) {
+    const auto &info = rec.inst_info[idx];
+    if (classify_inst(info.inst, info.is_rvc) != InstClass::plain) {
+      commit.full_check = true;
+    }
+    commit.dest_gpr[idx] = inst_dest_gpr(info.inst, info.is_rvc);
+  }
+  return commit;
+}
+
+static void task_difftest_mem(SimBase &sim_base, DiffTest &diff_ref,
+                              SimDevices::SynReadMemoryDev &sim_mem,
+                              const DiffTestOptions &options) {
+  if (!DiffTest::has_read_mem()) {
+    console->warn("rv64emu does not export read_mem, DiffTest memory check "
+                  "disabled");
+    return;
+  }
+
+  if (options.mem_mode == DiffMemMode::stream) {
+    // the batch mode steps the reference over many stores at once
+    if (options.mode == DiffMode::batch) {
+      console->warn("DiffTest store check needs --diff-mode=sync or "
+                    "pipeline, disabled");
+      return;
+    }
+    console->info("DiffTest store check on every committed store");
+    diff_ref.set_store_check(true);
+    return;
+  }
+
+  if (options.mode != DiffMode::sync) {
+    console->warn("DiffTest page check needs --diff-mode=sync, disabled");
+    return;
+  }
+  console->warn("DiffTest page check every {} cycles, unreliable: lines "
+                "still dirty in the DCache can be reported",
+                options.mem_interval);
+  auto mem_check = std::make_shared<DiffTestMem>(diff_ref, sim_mem);
+  sim_base.add_after_clk_rise_task({.task_func =
+                                        [&sim_base, mem_check] {
+                                          if (!mem_check->check()) {
+                                            sim_base.set_state(
+                                                SimBase::sim_abort);
+                                          }
+                                        },
+                                    .name = "difftest memory",
+                                    .period_cycle = options.mem_interval,
+                                    .type = SimTaskType::period});
+  sim_base.add_run_end_task(
+      {.task_func = [mem_check] { mem_check->print_stats(); },
+       .name = "difftest memory stats"});
+}
+
+static void task_difftest_sync(SimBase &sim_base, DiffTest &diff_ref) {
+  sim_base.add_commit_listener(
+      {.listener_func =
+           [&sim_base, &diff_ref, seq = uint64_t(0)](
+               const CommitRecord &rec) mutable {
+             if (diff_ref.check_commit(make_diff_commit(rec, seq++))) {
+               sim_base.set_state(SimBase::sim_abort);
+             }
+           },
+       .name = "difftest"});
+}
+
+static void task_difftest_batch(SimBase &sim_base, DiffTest &diff_ref,
+                                const DiffTestOptions &options) {
+  console->info("DiffTest batch mode, {} insts per batch", options.batch_size);
+  auto batch = std::make_shared<DiffTestBatch>(diff_ref, options.batch_size,
+                                               options.replay_limit);
+  sim_base.add_commit_listener(
+      {.listener_func =
+           [&sim_base, batch, seq = uint64_t(0)](
+               const CommitRecord &rec) mutable {
+             if (!batch->push(make_diff_commit(rec, seq++))) {
+               sim_base.set_state(SimBase::sim_abort);
+             }
+           },
+       .name = "difftest batch"});
+  sim_base.add_run_end_task({.task_func =
+                                 [&sim_base, batch] {
+                                   if (!batch->flush()) {
+                                     sim_base.set_state(SimBase::sim_abort);
+                                   }
+                                   batch->print_stats();
+                                 },
+                             .name = "difftest batch flush"});
+}
+
+static void task_difftest_pipeline(SimBase &sim_base, DiffTest &diff_ref) {
+  console->info("DiffTest pipeline mode, max {} commits in flight",
+                DIFF_PIPELINE_DEPTH);
+  auto pipeline =
+      std::make_shared<DiffTestPipeline>(diff_ref, DIFF_PIPELINE_DEPTH);
+  sim_base.add_commit_listener(
+      {.listener_func =
+           [&sim_base, pipeline, seq = uint64_t(0)](
+               const CommitRecord &rec) mutable {
+             if (!pipeline->push(make_diff_commit(rec, seq++))) {
+               sim_base.set_state(SimBase::sim_abort);
+             }
+           },
+       .name = "difftest pipeline"});
+  sim_base.add_run_end_task({.task_func =
+                                 [&sim_base, pipeline] {
+                                   if (!pipeline->sync()) {
+                                     pipeline->report_mismatch();
+                                     sim_base.set_state(SimBase::sim_abort);
+                                   }
+                                   // the DiffTest is destroyed before sim_base
+                                   pipeline->stop();
+                                 },
+                             .name = "difftest pipeline sync"});
+}
+
 void task_difftest(SimBase &sim_base, std::optional<DiffTest> &diff_ref,
-                   std::string image_name, bool difftest_en) {
-
-  if (difftest_en) {
-    diff_trace = spdlog::get("diff_trace");
-    console = spdlog::get("console");
-
-    diff_ref.emplace(BOOT_PC, MEM_SIZE, MEM_BASE);
-    diff_ref->load_file(image_name.c_str());
-    sim_base.add_after_clk_rise_task(
-        {.task_func =
-             [&sim_base, &diff_ref] {
-               const auto top = sim_base.top;
-               // diff test
-               if (top->io_difftest_valid) {
-                 const auto step_num = top->io_difftest_bits_commited_num;
-                 const auto has_exception =
-                     top->io_difftest_bits_exception_valid;
-                 const auto has_interrupt = top->io_difftest_bits_has_interrupt;
-                 const auto cause = top->io_difftest_bits_exception_cause;
-                 const auto has_mmio = top->io_difftest_bits_contain_mmio;
-                 const auto has_csr_skip = top->io_difftest_bits_csr_skip;
-                 const auto is_rvc = top->io_difftest_bits_last_is_rvc;
-                 const auto pc = top->io_difftest_bits_last_pc;
-                 const auto next_pc = pc + (is_rvc ? 2 : 4); // for diff skip
-
-                 if (has_interrupt & has_exception ||
-                     has_exception & has_mmio || has_exception & has_csr_skip ||
-                     has_mmio & has_csr_skip || has_interrupt & has_mmio ||
-                     has_interrupt & has_csr_skip) {
-                   console->critical(
-                       "exception and interrupt and mmio at the same time");
-                   console->critical(
-                       "has_interrupt: {}, has_exception: {}, has_mmio: {}, "
-                       "has_csr_skip: {}\n",
-                       has_interrupt, has_exception, has_mmio, has_csr_skip);
-                   sim_base.set_state(SimBase::sim_abort);
-                 }
-
-                 if (has_mmio || has_csr_skip) {
-                   diff_trace->info(
-                       "skip mmio or csr at pc: 0x{:016x},next pc: 0x{:016x}",
-                       sim_base.get_pc(), next_pc);
-                   diff_ref->ref_skip(
-                       [&](const size_t idx) { return sim_base.get_reg(idx); },
-                       next_pc);
-                 } else {
-                   diff_ref->step(step_num);
-
-                   diff_trace->info(
-                       "Commit {} inst at pc: 0x{:016x},next pc: 0x{:016x}",
-                       step_num, sim_base.get_pc(), next_pc);
-
-                   if (has_interrupt) {
-                     diff_trace->info(
-                         "has_interrupt at pc: 0x{:016x},cause: 0x{:8x}",
-                         sim_base.get_pc(), cause);
-                     diff_ref->raise_intr(cause & 0xffff);
-                   }
-                   const bool pc_mismatch = diff_ref->check_pc(
-                       diff_ref->get_pc(), sim_base.get_pc());
-                   const bool gpr_mismatch = diff_ref->check_gprs(
-                       [&](const size_t idx) { return sim_base.get_reg(idx); },
-                       [&](const size_t idx) {
-                         return diff_ref->get_reg(idx);
-                       });
-                   const bool csr_mismatch = diff_ref->check_csrs(
-                       [&](const size_t idx) { return sim_base.get_csr(idx); });
-                   const bool mismatch =
-                       pc_mismatch | gpr_mismatch | csr_mismatch;
-
-                   if (mismatch) {
-                     console->critical("DiffTest mismatch");
-                     console->critical("pc mismatch: ref: 0x{:08x}, dut: "
-                                       "0x{:08x}\n\n",
-                                       diff_ref->get_pc(), sim_base.get_pc());
-                     sim_base.set_state(SimBase::sim_abort);
-                   }
-                   diff_trace->info("--------------------End DiffTest at pc: "
-                                    "0x{:016x}----------------------\n",
-                                    sim_base.get_pc());
-                 }
-               }
-             },
-         .name = "difftest",
-         .period_cycle = 0,
-         .type = SimTaskType::period});
+                   SimDevices::SynReadMemoryDev &sim_mem,
+                   const SimDevices::DeviceMange &device_manager,
+                   std::string image_name, bool difftest_en,
+                   const DiffTestOptions &options) {
+
+  if (!difftest_en) {
+    return;
+  }
+  console = spdlog::get("console");
+
+  diff_ref.emplace(BOOT_PC, sim_mem.get_mem_size(), sim_mem.get_mem_addr());
+  diff_ref->load_file(image_name.c_str());
+  diff_ref->set_csr_check(options.csr_check);
+  diff_ref->set_skip_mode(options.skip_mode);
+  if (diff_ref->trace_enabled()) {
+    diff_ref->set_trace_task(sim_base.make_async_task<DiffTest::TraceEntry>(
+        "difftest log", [&diff_ref](const DiffTest::TraceEntry &entry) {
+          diff_ref->print_trace(entry);
+        }));
   }
+
+  if (options.mem_check) {
+    task_difftest_mem(sim_base, *diff_ref, sim_mem, options);
+  }
+
+  switch (options.mode) {
+  case DiffMode::sync:
+    task_difftest_sync(sim_base, *diff_ref);
+    break;
+  case DiffMode::batch:
+    task_difftest_batch(sim_base, *diff_ref, options);
+    break;
+  case DiffMode::pipeline:
+    task_difftest_pipeline(sim_base, *diff_ref);
+    break;
+  }
+
+  // after the batch flush / pipeline sync, the reference is idle by then
+  sim_base.add_run_end_task(
+      {.task_func =
+           [&diff_ref, &device_manager] {
+             diff_ref->print_skip_stats([&](const uint64_t addr) {
+               return device_manager.device_name(addr).value_or(
+                   std::format("soc 0x{:08x}", addr));
+             });
+           },
+       .name = "difftest skip stats"});
 }
\ No newline at end of file
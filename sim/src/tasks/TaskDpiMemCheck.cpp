@@ -0,0 +1,39 @@
+#include "AllTask.h"
+#include "DpiMemory.h"
+
+static std::shared_ptr<spdlog::logger> console = nullptr;
+
+// the core fetches from RAM right after reset, by then every SoC with the
+// DPI-C memory port has served a burst
+static constexpr uint64_t check_cycles = 4096;
+
+/**
+ * @brief The L2 and DRAM models only time DPI-C bursts. A SoC generated with
+ * --no-dpi-mem serves RAM over mem_port instead, where they would silently do
+ * nothing, so the run is stopped.
+ */
+void task_dpi_mem_check(SimBase &sim_base, bool models_en) {
+  if (!models_en) {
+    return;
+  }
+  console = spdlog::get("console");
+  sim_base.add_after_clk_rise_task(
+      {.task_func =
+           [&sim_base, checked = false]() mutable {
+             if (checked) {
+               return;
+             }
+             checked = true;
+             if (SimDevices::dpi_bursts() == 0) {
+               console->critical(
+                   "no DPI-C memory burst in {} cycles, the SoC was "
+                   "generated with --no-dpi-mem: --l2 and --dram need the "
+                   "DPI-C memory port\n",
+                   check_cycles);
+               sim_base.set_state(SimBase::sim_abort);
+             }
+           },
+       .name = "dpi memory check",
+       .period_cycle = check_cycles,
+       .type = SimTaskType::period});
+}
@@ -0,0 +1,41 @@
+#include "AllTask.h"
+#include "DpiMemory.h"
+
+static std::shared_ptr<spdlog::logger> console = nullptr;
+
+void task_dram(SimBase &sim_base, std::optional<SimDevices::DramModel> &dram,
+               const DramOptions &options) {
+  if (options.preset == "off") {
+    return;
+  }
+  console = spdlog::get("console");
+
+  auto config = SimDevices::DramConfig::preset(options.preset).value();
+  const auto override_with = [](uint32_t &param,
+                                const std::optional<uint32_t> &value) {
+    if (value.has_value()) {
+      param = value.value();
+    }
+  };
+  override_with(config.banks, options.banks);
+  override_with(config.row_bytes, options.row_bytes);
+  override_with(config.t_cas, options.t_cas);
+  override_with(config.t_rcd, options.t_rcd);
+  override_with(config.t_rp, options.t_rp);
+  override_with(config.t_refi, options.t_refi);
+  override_with(config.t_rfc, options.t_rfc);
+  override_with(config.queue_depth, options.queue_depth);
+
+  dram.emplace(config);
+  SimDevices::bind_dpi_dram(&dram.value(), &sim_base.cycle_num);
+  console->info("DRAM model {}: {} banks, {} B rows, tCAS {} tRCD {} tRP {} "
+                "tREFI {} tRFC {} queue {}",
+                config.name, config.banks, config.row_bytes, config.t_cas,
+                config.t_rcd, config.t_rp, config.t_refi, config.t_rfc,
+                config.queue_depth);
+
+  sim_base.add_run_end_task({.task_func = [&dram] { dram->print_stats(); },
+                             .name = "DRAM stats",
+                             .period_cycle = 0,
+                             .type = SimTaskType::once});
+}
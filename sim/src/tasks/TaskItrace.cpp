@@ -1,4 +1,3 @@
-
 #include "AllTask.h"
 
 static std::shared_ptr<spdlog::logger> itrace_log = nullptr;
@@ -9,50 +8,28 @@ void task_itrace(SimBase &sim_base, std::optional<Itrace> &itrace,
   if (itrace_log_enable) {
     itrace_log = spdlog::get("itrace");
     itrace.emplace();
-    sim_base.add_after_clk_rise_task(
-        {.task_func =
-             [&sim_base, &itrace] {
-               const auto top = sim_base.top;
-               if (top->io_difftest_valid) {
-                 const auto has_exception =
-                     top->io_difftest_bits_exception_valid;
-                 const auto has_interrupt = top->io_difftest_bits_has_interrupt;
-                 const auto cause = top->io_difftest_bits_exception_cause;
-                 const auto pc = top->io_difftest_bits_last_pc;
-
-                 if (has_exception) {
-                   itrace->riscv_disasm(top->io_difftest_bits_inst_info_0_inst,
-                                        top->io_difftest_bits_last_pc);
-                   itrace_log->info("⬆️ pc 0x{:08x},exception cause 0x{:x}\n",
-                                    pc, cause);
-                 } else if (has_interrupt) {
-                   itrace->riscv_disasm(top->io_difftest_bits_inst_info_0_inst,
-                                        top->io_difftest_bits_last_pc);
-                   itrace_log->info("⬆️ pc 0x{:08x},interrupt cause 0x{:x}\n",
-                                    pc, cause);
-                 } else {
-                   const auto pc_list = std::array{
-                       static_cast<uint64_t>(
-                           top->io_difftest_bits_inst_info_0_pc),
-                       static_cast<uint64_t>(
-                           top->io_difftest_bits_inst_info_1_pc),
-                   };
-                   const auto inst_list = std::array{
-                       static_cast<uint32_t>(
-                           top->io_difftest_bits_inst_info_0_inst),
-                       static_cast<uint32_t>(
-                           top->io_difftest_bits_inst_info_1_inst),
-                   };
-
-                   for (int i = 0; i < top->io_difftest_bits_commited_num;
-                        i++) {
-                     itrace->riscv_disasm(inst_list[i], pc_list[i]);
-                   }
-                 }
-               }
+    // disassembly works on a copy of the record, gpr()/csr() must not be used
+    auto itrace_print = sim_base.make_async_task<CommitRecord>(
+        "Inst Trace print", [&itrace](const CommitRecord &rec) {
+          if (rec.has_exception) {
+            itrace->riscv_disasm(rec.inst_info[0].inst, rec.pc);
+            itrace_log->info("⬆️ pc 0x{:08x},exception cause 0x{:x}\n", rec.pc,
+                             rec.cause);
+          } else if (rec.has_interrupt) {
+            itrace->riscv_disasm(rec.inst_info[0].inst, rec.pc);
+            itrace_log->info("⬆️ pc 0x{:08x},interrupt cause 0x{:x}\n", rec.pc,
+                             rec.cause);
+          } else {
+            for (int i = 0; i < rec.commit_num; i++) {
+              itrace->riscv_disasm(rec.inst_info[i].inst, rec.inst_info[i].pc);
+            }
+          }
+        });
+    sim_base.add_commit_listener(
+        {.listener_func =
+             [itrace_print](const CommitRecord &rec) {
+               itrace_print->post(rec);
              },
-         .name = "Inst Trace",
-         .period_cycle = 0,
-         .type = SimTaskType::period});
+         .name = "Inst Trace"});
   }
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "AllTask.h"
+#include "DpiMemory.h"
+
+static std::shared_ptr<spdlog::logger> console = nullptr;
+
+void task_l2(SimBase &sim_base, std::optional<SimDevices::L2Cache> &l2,
+             std::optional<SimDevices::DramModel> &dram,
+             PerfMonitor &perf_monitor, const L2Options &options) {
+  if (!options.enable) {
+    return;
+  }
+  console = spdlog::get("console");
+
+  const auto &config = options.config;
+  l2.emplace(config, dram.has_value() ? &dram.value() : nullptr);
+  SimDevices::bind_dpi_l2(&l2.value(), &sim_base.cycle_num);
+  console->info("L2 cache: {} KiB, {} ways, {} B lines, hit latency {}, {}",
+                config.size / 1024, config.ways, config.line_bytes,
+                config.hit_latency,
+                dram.has_value()
+                    ? std::format("misses go to DRAM {}",
+                                  dram->get_config().name)
+                    : std::format("miss penalty {}", config.miss_penalty));
+
+  perf_monitor.add_perf_counter({"l2", &l2->hits, &l2->accesses});
+  // dirty victims per miss
+  perf_monitor.add_perf_counter({"l2_wb", &l2->writebacks, &l2->misses});
+}
@@ -0,0 +1,33 @@
+#include "AllTask.h"
+#include "DpiMemory.h"
+
+static std::shared_ptr<spdlog::logger> console = nullptr;
+
+void task_mem_trace(SimBase &sim_base,
+                    std::optional<SimDevices::MemTraceWriter> &trace,
+                    SimDevices::DeviceMange &device_manager,
+                    const std::string &trace_file) {
+  if (trace_file.empty()) {
+    return;
+  }
+  console = spdlog::get("console");
+
+  trace.emplace(trace_file, &sim_base.cycle_num);
+  device_manager.set_trace(&trace.value());
+  SimDevices::bind_dpi_trace(&trace.value());
+  console->info("Mem trace: recording to {}", trace_file);
+
+  sim_base.add_run_end_task(
+      {.task_func =
+           [&trace, &device_manager, trace_file] {
+             device_manager.set_trace(nullptr);
+             SimDevices::bind_dpi_trace(nullptr);
+             trace->close();
+             console->info("Mem trace: {} records, {} bytes in {}",
+                           trace->get_records(), trace->get_bytes(),
+                           trace_file);
+           },
+       .name = "mem trace close",
+       .period_cycle = 0,
+       .type = SimTaskType::once});
+}
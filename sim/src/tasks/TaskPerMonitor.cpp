@@ -27,8 +27,18 @@ void task_perfmonitor(SimBase &sim_base, PerfMonitor &perf_monitor,
       {"CPI", &sim_base.cycle_num, &sim_base.commit_num});
 
   if (perf_trace_log_en) {
+    // only the counter snapshot is taken on the sim thread
+    auto perf_print = sim_base.make_async_task<PerfMonitor::Snapshot>(
+        "perf_monitor print",
+        [&perf_monitor](const PerfMonitor::Snapshot &snap) {
+          perf_monitor.print_perf_snapshot(snap, false);
+        },
+        1);
     sim_base.add_after_clk_rise_task(
-        {.task_func = [&] { perf_monitor.print_perf_counter(false); },
+        {.task_func =
+             [&perf_monitor, perf_print] {
+               perf_print->post(perf_monitor.snapshot());
+             },
          .name = "perf_monitor",
          .period_cycle = 8192,
          .type = SimTaskType::period});
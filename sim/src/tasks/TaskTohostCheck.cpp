@@ -101,6 +101,14 @@ void task_tohost_check(SimBase &sim_base, SimDevices::SynReadMemoryDev &sim_mem,
                  top->io_tohost_addr_valid = true;
                  console->info("Set to_host_addr: 0x{:016x}\n",
                                sim_mem.get_to_host_addr().value());
+                 // for riscof and riscv-tests, use to_host to communicate
+                 // with simulation environment. Handled in the cycle the
+                 // store reaches memory, nothing runs while it is idle
+                 const auto to_host = sim_mem.get_to_host_addr().value();
+                 sim_mem.add_write_watch(
+                     to_host, to_host + 8, [&sim_mem](uint64_t, uint8_t) {
+                       sim_mem.check_to_host(tohost_callback_func);
+                     });
                } else {
                  top->io_tohost_addr_valid = false;
                  top->io_tohost_addr_bits = 0;
@@ -111,16 +119,5 @@ void task_tohost_check(SimBase &sim_base, SimDevices::SynReadMemoryDev &sim_mem,
          .name = "Set to_host_addr",
          .period_cycle = 0,
          .type = SimTaskType::once});
-
-    // for riscof and riscv-tests, use to_host to communicate with simulation
-    // environment
-    sim_base.add_after_clk_rise_task({.task_func =
-                                          [&sim_mem, &sim_base] {
-                                            sim_mem.check_to_host(
-                                                tohost_callback_func);
-                                          },
-                                      .name = "to_host_check",
-                                      .period_cycle = 1024,
-                                      .type = SimTaskType::period});
   }
 }
\ No newline at end of file
@@ -46,28 +46,23 @@ void task_uart_io(SimBase &sim_base) {
   std::thread rx_thread(uart_rx_thread, pipe_fd[1]);
   rx_thread.detach();
 
-  sim_base.add_after_clk_rise_task({.task_func =
-                                        [&] {
-                                          const auto top = sim_base.top;
+  sim_base.add_after_clk_rise_task("UartFifoTask", [&] {
+    const auto top = sim_base.top;
 
-                                          // tx
-                                          top->io_uart_tx_deq_ready = 1;
-                                          if (top->io_uart_tx_deq_valid) {
-                                            char c = static_cast<char>(
-                                                top->io_uart_tx_deq_bits);
-                                            std::printf("%c", c);
-                                          }
-                                          // rx, try to read from pipe
-                                          top->io_uart_rx_enq_valid = 0;
-                                          if (top->io_uart_rx_enq_ready) {
-                                            char c;
-                                            if (read(pipe_fd[0], &c, 1) == 1) {
-                                              top->io_uart_rx_enq_valid = 1;
-                                              top->io_uart_rx_enq_bits = c;
-                                            }
-                                          }
-                                        },
-                                    .name = "UartFifoTask",
-                                    .period_cycle = 0,
-                                    .type = SimTaskType::period});
+    // tx
+    top->io_uart_tx_deq_ready = 1;
+    if (top->io_uart_tx_deq_valid) {
+      char c = static_cast<char>(top->io_uart_tx_deq_bits);
+      std::printf("%c", c);
+    }
+    // rx, try to read from pipe
+    top->io_uart_rx_enq_valid = 0;
+    if (top->io_uart_rx_enq_ready) {
+      char c;
+      if (read(pipe_fd[0], &c, 1) == 1) {
+        top->io_uart_rx_enq_valid = 1;
+        top->io_uart_rx_enq_bits = c;
+      }
+    }
+  });
 }
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "DiffTestBatch.h"
+#include "spdlog/sinks/null_sink.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <unordered_map>
+
+// A fake rv64emu: every step runs "addi t0, t0, 1" and moves pc by 4. Nothing
+// else changes, so the reference never writes t1. Memory reads back the
+// words put into FakeHart::mem.
+namespace {
+constexpr uint64_t boot_pc = 0x80000000;
+constexpr uint8_t reg_t0 = 5;
+constexpr uint8_t reg_t1 = 6;
+
+struct FakeHart {
+  uint64_t pc;
+  std::array<uint64_t, 32> gpr{};
+  std::unordered_map<uint64_t, uint64_t> csr;
+  std::unordered_map<uint64_t, uint64_t> mem;
+};
+
+// the hart of the last created reference
+FakeHart *last_hart = nullptr;
+
+FakeHart &hart(Rv64emuBridge *rv64emu) {
+  return *static_cast<FakeHart *>(rv64emu->sim);
+}
+} // namespace
+
+extern "C" {
+Rv64emuBridge *create_rv64emu(const char *, const char *,
+                              const uint64_t boot_pc, uintptr_t, uintptr_t,
+                              uintptr_t, bool, bool, bool) {
+  last_hart = new FakeHart{.pc = boot_pc};
+  return new Rv64emuBridge{last_hart};
+}
+
+void destroy_rv64emu(Rv64emuBridge *rv64emu) {
+  delete static_cast<FakeHart *>(rv64emu->sim);
+  delete rv64emu;
+}
+
+void load_file(Rv64emuBridge *, const char *) {}
+
+void step(Rv64emuBridge *rv64emu, const uint64_t steps) {
+  hart(rv64emu).pc += 4 * steps;
+  hart(rv64emu).gpr[reg_t0] += steps;
+}
+
+void raise_intr(Rv64emuBridge *, uint64_t) {}
+
+uint64_t get_pc(Rv64emuBridge *rv64emu) { return hart(rv64emu).pc; }
+
+void set_pc(Rv64emuBridge *rv64emu, const uint64_t pc) {
+  hart(rv64emu).pc = pc;
+}
+
+uint64_t get_reg(Rv64emuBridge *rv64emu, const uintptr_t idx) {
+  return hart(rv64emu).gpr[idx];
+}
+
+void set_reg(Rv64emuBridge *rv64emu, const uintptr_t idx, const uint64_t val) {
+  if (idx != 0) {
+    hart(rv64emu).gpr[idx] = val;
+  }
+}
+
+uint64_t get_csr(Rv64emuBridge *rv64emu, const uint64_t addr) {
+  return hart(rv64emu).csr[addr];
+}
+
+void set_csr(Rv64emuBridge *rv64emu, const uint64_t addr, const uint64_t val) {
+  hart(rv64emu).csr[addr] = val;
+}
+
+bool read_mem(Rv64emuBridge *rv64emu, const uint64_t addr, uint8_t *buf,
+              const uintptr_t len) {
+  const auto it = hart(rv64emu).mem.find(addr);
+  if (len != sizeof(uint64_t) || it == hart(rv64emu).mem.end()) {
+    return false;
+  }
+  std::memcpy(buf, &it->second, len);
+  return true;
+}
+} // extern "C"
+
+namespace {
+void init_loggers() {
+  if (spdlog::get("console") == nullptr) {
+    spdlog::create<spdlog::sinks::null_sink_mt>("console");
+    spdlog::create<spdlog::sinks::null_sink_mt>("diff_trace")
+        ->set_level(spdlog::level::off);
+  }
+}
+
+// DUT state after n "addi t0, t0, 1" commits, the last one writes rd
+DiffCommit dut_commit(const uint64_t n, const uint8_t rd) {
+  DiffCommit commit;
+  commit.seq = n - 1;
+  commit.cycle = n;
+  commit.commit_num = 1;
+  commit.full_check = false;
+  commit.dest_gpr[0] = rd;
+  commit.state.pc = boot_pc + 4 * n;
+  commit.state.gpr[reg_t0] = n;
+  commit.next_pc = commit.state.pc + 4;
+  return commit;
+}
+} // namespace
+
+TEST_CASE("incremental check_state only sees the destination unless forced",
+          "[difftest]") {
+  init_loggers();
+  auto diff_ref = DiffTest(boot_pc, 0x1000, boot_pc);
+  diff_ref.set_csr_check(DiffCsrCheck::incremental);
+  diff_ref.step(1);
+
+  // t1 diverged earlier, this commit only writes t0
+  auto commit = dut_commit(1, reg_t0);
+  commit.state.gpr[reg_t1] = 0xbad;
+
+  CHECK_FALSE(diff_ref.check_state(commit));
+  CHECK(diff_ref.check_state(commit, true));
+
+  SECTION("full_check commits compare everything") {
+    commit.full_check = true;
+    CHECK(diff_ref.check_state(commit));
+  }
+}
+
+TEST_CASE("batch boundary finds a divergence outside the last destination",
+          "[difftest]") {
+  init_loggers();
+  auto diff_ref = DiffTest(boot_pc, 0x1000, boot_pc);
+  diff_ref.set_csr_check(DiffCsrCheck::incremental);
+  constexpr uint64_t batch_size = 16;
+  auto batch = DiffTestBatch(diff_ref, batch_size, 0);
+
+  SECTION("clean batches pass") {
+    for (uint64_t n = 1; n <= 4 * batch_size; n++) {
+      REQUIRE(batch.push(dut_commit(n, reg_t0)));
+    }
+    CHECK(batch.flush());
+  }
+
+  SECTION("a wrong t1 in the middle of the batch is reported") {
+    bool ok = true;
+    for (uint64_t n = 1; n <= batch_size && ok; n++) {
+      auto commit = dut_commit(n, n == 5 ? reg_t1 : reg_t0);
+      if (n >= 5) {
+        commit.state.gpr[reg_t1] = 0xbad;
+      }
+      ok = batch.push(commit);
+    }
+    // the last commit of the batch only writes t0
+    CHECK_FALSE(ok);
+  }
+
+  SECTION("a divergence in an open batch is reported by flush") {
+    for (uint64_t n = 1; n < batch_size / 2; n++) {
+      auto commit = dut_commit(n, reg_t0);
+      commit.state.gpr[reg_t1] = n >= 3 ? 0xbad : 0;
+      REQUIRE(batch.push(commit));
+    }
+    CHECK_FALSE(batch.flush());
+  }
+}
+
+TEST_CASE("check_store compares the committed bytes with the reference",
+          "[difftest]") {
+  init_loggers();
+  constexpr uint64_t data_addr = boot_pc + 0x1000;
+  auto diff_ref = DiffTest(boot_pc, 0x2000, boot_pc);
+  diff_ref.set_store_check(true);
+  REQUIRE(DiffTest::has_read_mem());
+  last_hart->mem[data_addr] = 0x1122'3344'beef'7788;
+
+  // "sh" of 0xbeef to data_addr + 2, lane aligned like the AXI wdata
+  auto commit = dut_commit(1, reg_t0);
+  commit.store = {.valid = true,
+                  .paddr = data_addr + 2,
+                  .wdata = 0x0000'0000'beef'0000,
+                  .wstrb = 0b0000'1100};
+  CHECK_FALSE(diff_ref.check_store(commit));
+
+  SECTION("a wrong byte inside the strobe is reported") {
+    commit.store.wdata = 0x0000'0000'beee'0000;
+    CHECK(diff_ref.check_store(commit));
+  }
+  SECTION("check_commit checks the store after stepping") {
+    commit.store.wdata = 0x0000'0000'beee'0000;
+    CHECK(diff_ref.check_commit(commit));
+    diff_ref.set_store_check(false);
+    CHECK_FALSE(diff_ref.check_commit(dut_commit(2, reg_t0)));
+  }
+  SECTION("stores outside the reference memory are not compared") {
+    commit.store.paddr = data_addr + 0x100;
+    commit.store.wdata = 0;
+    CHECK_FALSE(diff_ref.check_store(commit));
+  }
+}
@@ -0,0 +1,86 @@
+#include "DramModel.h"
+#include <catch2/catch_test_macros.hpp>
+
+using namespace SimDevices;
+
+namespace {
+// rows of 1 KiB interleaved over 2 banks: addr 0 and 2048 share bank 0,
+// 1024 is bank 1
+DramConfig test_config() {
+  return {.name = "test",
+          .banks = 2,
+          .row_bytes = 1024,
+          .t_cas = 10,
+          .t_rcd = 20,
+          .t_rp = 30,
+          .t_burst = 1,
+          .t_refi = 0,
+          .t_rfc = 0,
+          .queue_depth = 4};
+}
+} // namespace
+
+TEST_CASE("dram row hit, empty and conflict timing", "[dram]") {
+  auto dram = DramModel(test_config());
+
+  // tRCD + tCAS
+  CHECK(dram.access(0, 0, 1, false) == 30);
+  // tCAS
+  CHECK(dram.access(1000, 8, 1, false) == 10);
+  // tRP + tRCD + tCAS
+  CHECK(dram.access(2000, 2048, 1, false) == 60);
+  // the other bank is still closed
+  CHECK(dram.access(3000, 1024, 1, false) == 30);
+  // a write is done after its last beat
+  CHECK(dram.access(4000, 2048 + 64, 8, true) == 18);
+
+  const auto &stats = dram.get_stats();
+  CHECK(stats.row_empty == 2);
+  CHECK(stats.row_hits == 2);
+  CHECK(stats.row_conflicts == 1);
+  CHECK(stats.reads == 4);
+  CHECK(stats.writes == 1);
+  CHECK(stats.bytes == 12 * 8);
+}
+
+TEST_CASE("dram bursts share the data bus", "[dram]") {
+  auto dram = DramModel(test_config());
+  CHECK(dram.access(0, 0, 8, false) == 30);
+  // bank 1 is ready at 30 too, but the bus is busy until 38
+  CHECK(dram.access(0, 1024, 8, false) == 38);
+}
+
+TEST_CASE("dram queue depth stalls the next burst", "[dram]") {
+  auto config = test_config();
+  config.queue_depth = 1;
+  auto dram = DramModel(config);
+  // done at 31
+  CHECK(dram.access(0, 0, 1, false) == 30);
+  // a row hit, but it can only start when the first burst is done
+  CHECK(dram.access(0, 8, 1, false) == 41);
+  CHECK(dram.get_stats().queue_stalls == 1);
+}
+
+TEST_CASE("dram refresh closes the rows", "[dram]") {
+  auto config = test_config();
+  config.t_refi = 100;
+  config.t_rfc = 50;
+  auto dram = DramModel(config);
+  CHECK(dram.access(0, 0, 1, false) == 30);
+  // refresh at 100 keeps the banks busy until 150 and closes the row
+  CHECK(dram.access(120, 8, 1, false) == 30 + 30);
+  CHECK(dram.get_stats().row_empty == 2);
+  // 200, 300 and 400 are counted without replaying them
+  CHECK(dram.access(450, 8, 1, false) == 30);
+  CHECK(dram.get_stats().refreshes == 4);
+}
+
+TEST_CASE("dram presets", "[dram]") {
+  for (const auto &name : DramConfig::preset_names()) {
+    INFO(name);
+    const auto config = DramConfig::preset(name);
+    REQUIRE(config.has_value());
+    CHECK(config->name == name);
+  }
+  CHECK_FALSE(DramConfig::preset("ddr2-800").has_value());
+}
@@ -0,0 +1,135 @@
+#include "InstDecode.h"
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string_view>
+
+namespace {
+struct DecodeCase {
+  std::string_view asm_text;
+  uint32_t inst;
+  bool is_rvc;
+  InstClass inst_class;
+  uint8_t rd;
+};
+
+// encodings from llvm-mc -triple=riscv64 -mattr=+m,+a,+c -show-encoding
+constexpr auto decode_cases = std::array{
+    // plain, writes rd
+    DecodeCase{"add a0, a1, a2", 0x00c58533, false, InstClass::plain, 10},
+    DecodeCase{"addi t0, t1, 5", 0x00530293, false, InstClass::plain, 5},
+    DecodeCase{"lui s1, 0x12345", 0x123454b7, false, InstClass::plain, 9},
+    DecodeCase{"auipc a5, 1", 0x00001797, false, InstClass::plain, 15},
+    DecodeCase{"jal ra, 16", 0x010000ef, false, InstClass::plain, 1},
+    DecodeCase{"jalr t2, 0(t3)", 0x000e03e7, false, InstClass::plain, 7},
+    DecodeCase{"ld a3, 8(sp)", 0x00813683, false, InstClass::plain, 13},
+    DecodeCase{"addiw a4, a4, 1", 0x0017071b, false, InstClass::plain, 14},
+    DecodeCase{"subw s2, s3, s4", 0x4149893b, false, InstClass::plain, 18},
+    DecodeCase{"amoadd.d a6, a7, (s0)", 0x0114382f, false, InstClass::plain,
+               16},
+    // plain, no destination
+    DecodeCase{"sd a3, 8(sp)", 0x00d13423, false, InstClass::plain, 0},
+    DecodeCase{"beq a0, a1, 16", 0x00b50863, false, InstClass::plain, 0},
+    DecodeCase{"fence", 0x0ff0000f, false, InstClass::plain, 0},
+    DecodeCase{"addi zero, zero, 0", 0x00000013, false, InstClass::plain, 0},
+    DecodeCase{"wfi", 0x10500073, false, InstClass::plain, 0},
+    // system
+    DecodeCase{"csrrw a0, mstatus, a1", 0x30059573, false, InstClass::csr_op,
+               10},
+    DecodeCase{"csrrsi zero, mie, 8", 0x30446073, false, InstClass::csr_op, 0},
+    DecodeCase{"ecall", 0x00000073, false, InstClass::trap, 0},
+    DecodeCase{"ebreak", 0x00100073, false, InstClass::trap, 0},
+    DecodeCase{"mret", 0x30200073, false, InstClass::xret, 0},
+    DecodeCase{"sret", 0x10200073, false, InstClass::xret, 0},
+    DecodeCase{"sfence.vma", 0x12000073, false, InstClass::sfence, 0},
+    DecodeCase{"funct3 = 4", 0x00004073, false, InstClass::unknown, 0},
+
+    // compressed, quadrant 0
+    DecodeCase{"c.addi4spn s0, sp, 16", 0x0800, true, InstClass::plain, 8},
+    DecodeCase{"c.lw a0, 4(a1)", 0x41c8, true, InstClass::plain, 10},
+    DecodeCase{"c.ld a2, 8(a3)", 0x6690, true, InstClass::plain, 12},
+    DecodeCase{"c.sw a0, 4(a1)", 0xc1c8, true, InstClass::plain, 0},
+    DecodeCase{"c.sd a2, 8(a3)", 0xe690, true, InstClass::plain, 0},
+    // quadrant 1
+    DecodeCase{"c.nop", 0x0001, true, InstClass::plain, 0},
+    DecodeCase{"c.addi a0, 1", 0x0505, true, InstClass::plain, 10},
+    DecodeCase{"c.addiw a1, 2", 0x2589, true, InstClass::plain, 11},
+    DecodeCase{"c.li a2, 3", 0x460d, true, InstClass::plain, 12},
+    DecodeCase{"c.lui a3, 4", 0x6691, true, InstClass::plain, 13},
+    DecodeCase{"c.addi16sp sp, 32", 0x6105, true, InstClass::plain, 2},
+    DecodeCase{"c.srli s0, 1", 0x8005, true, InstClass::plain, 8},
+    DecodeCase{"c.srai s1, 2", 0x8489, true, InstClass::plain, 9},
+    DecodeCase{"c.andi a0, 3", 0x890d, true, InstClass::plain, 10},
+    DecodeCase{"c.sub a1, a2", 0x8d91, true, InstClass::plain, 11},
+    DecodeCase{"c.xor a3, a4", 0x8eb9, true, InstClass::plain, 13},
+    DecodeCase{"c.or a5, s0", 0x8fc1, true, InstClass::plain, 15},
+    DecodeCase{"c.and s1, a0", 0x8ce9, true, InstClass::plain, 9},
+    DecodeCase{"c.subw a1, a2", 0x9d91, true, InstClass::plain, 11},
+    DecodeCase{"c.addw a3, a4", 0x9eb9, true, InstClass::plain, 13},
+    DecodeCase{"c.j 16", 0xa801, true, InstClass::plain, 0},
+    DecodeCase{"c.beqz a0, 16", 0xc901, true, InstClass::plain, 0},
+    DecodeCase{"c.bnez a1, 16", 0xe981, true, InstClass::plain, 0},
+    // quadrant 2
+    DecodeCase{"c.slli t0, 3", 0x028e, true, InstClass::plain, 5},
+    DecodeCase{"c.lwsp t1, 4(sp)", 0x4312, true, InstClass::plain, 6},
+    DecodeCase{"c.ldsp t2, 8(sp)", 0x63a2, true, InstClass::plain, 7},
+    DecodeCase{"c.jr ra", 0x8082, true, InstClass::plain, 0},
+    DecodeCase{"c.mv s2, s3", 0x894e, true, InstClass::plain, 18},
+    DecodeCase{"c.ebreak", 0x9002, true, InstClass::trap, 0},
+    DecodeCase{"c.jalr t0", 0x9282, true, InstClass::plain, 1},
+    DecodeCase{"c.add s4, s5", 0x9a56, true, InstClass::plain, 20},
+    DecodeCase{"c.swsp t1, 4(sp)", 0xc21a, true, InstClass::plain, 0},
+    DecodeCase{"c.sdsp t2, 8(sp)", 0xe41e, true, InstClass::plain, 0},
+};
+} // namespace
+
+TEST_CASE("classify_inst and inst_dest_gpr decode every class", "[decode]") {
+  for (const auto &test : decode_cases) {
+    INFO(test.asm_text);
+    CHECK(classify_inst(test.inst, test.is_rvc) == test.inst_class);
+    CHECK(inst_dest_gpr(test.inst, test.is_rvc) == test.rd);
+  }
+}
+
+TEST_CASE("compressed decode ignores the upper half word", "[decode]") {
+  // only the low half word of a compressed inst is decoded
+  for (const auto &test : decode_cases) {
+    if (!test.is_rvc) {
+      continue;
+    }
+    INFO(test.asm_text);
+    const uint32_t inst = test.inst | 0x00730000;
+    CHECK(classify_inst(inst, true) == test.inst_class);
+    CHECK(inst_dest_gpr(inst, true) == test.rd);
+  }
+}
+
+TEST_CASE("inst_mem_operand finds base and offset", "[decode]") {
+  uint8_t rs1 = 0;
+  int64_t imm = 0;
+
+  SECTION("ld a3, 8(sp)") {
+    REQUIRE(inst_mem_operand(0x00813683, false, rs1, imm));
+    CHECK(rs1 == 2);
+    CHECK(imm == 8);
+  }
+  SECTION("sd with a negative offset: sd a0, -16(s0)") {
+    REQUIRE(inst_mem_operand(0xfea43823, false, rs1, imm));
+    CHECK(rs1 == 8);
+    CHECK(imm == -16);
+  }
+  SECTION("c.lw a0, 4(a1)") {
+    REQUIRE(inst_mem_operand(0x41c8, true, rs1, imm));
+    CHECK(rs1 == 11);
+    CHECK(imm == 4);
+  }
+  SECTION("c.sd a2, 8(a3)") {
+    REQUIRE(inst_mem_operand(0xe690, true, rs1, imm));
+    CHECK(rs1 == 13);
+    CHECK(imm == 8);
+  }
+  SECTION("no memory access") {
+    CHECK_FALSE(inst_mem_operand(0x00c58533, false, rs1, imm));
+    CHECK_FALSE(inst_mem_operand(0x0505, true, rs1, imm));
+  }
+}
@@ -0,0 +1,113 @@
+#include "L2Cache.h"
+#include <catch2/catch_test_macros.hpp>
+
+using namespace SimDevices;
+
+namespace {
+constexpr uint64_t line_bytes = 64;
+constexpr uint32_t hit_latency = 10;
+constexpr uint32_t miss_penalty = 100;
+
+// 2 sets of 2 ways, even lines go to set 0
+L2Config test_config(const L2Replacement replacement) {
+  return {.size = 2 * 2 * line_bytes,
+          .ways = 2,
+          .line_bytes = line_bytes,
+          .replacement = replacement,
+          .hit_latency = hit_latency,
+          .miss_penalty = miss_penalty};
+}
+
+uint64_t line_addr(const uint64_t line_idx) { return line_idx * line_bytes; }
+
+// read lines 0, 2 and 4 of set 0 round robin, rounds times
+uint64_t thrash_hits(const L2Replacement replacement, const size_t rounds) {
+  auto l2 = L2Cache(test_config(replacement), nullptr);
+  for (size_t i = 0; i < rounds; i++) {
+    for (const uint64_t line_idx : {0, 2, 4}) {
+      l2.access(i, line_addr(line_idx), 1, false);
+    }
+  }
+  return l2.hits;
+}
+} // namespace
+
+TEST_CASE("l2 hit and miss latency", "[l2]") {
+  auto l2 = L2Cache(test_config(L2Replacement::lru), nullptr);
+
+  CHECK(l2.access(0, line_addr(1), 1, false) == hit_latency + miss_penalty);
+  CHECK(l2.access(1, line_addr(1) + 8, 1, false) == hit_latency);
+  // the other set is still empty
+  CHECK(l2.access(2, line_addr(0), 1, false) == hit_latency + miss_penalty);
+  CHECK(l2.accesses == 3);
+  CHECK(l2.hits == 1);
+  CHECK(l2.misses == 2);
+  CHECK(l2.writebacks == 0);
+
+  SECTION("a full line write allocates without a fill") {
+    CHECK(l2.access(3, line_addr(3), line_bytes / 8, true) == hit_latency);
+    CHECK(l2.misses == 3);
+    CHECK(l2.access(4, line_addr(3), 1, false) == hit_latency);
+  }
+  SECTION("a partial write misses like a read") {
+    CHECK(l2.access(3, line_addr(3), 1, true) == hit_latency + miss_penalty);
+  }
+  SECTION("a burst across two lines looks up both") {
+    CHECK(l2.access(3, line_addr(1) + 32, 8, false) ==
+          hit_latency + miss_penalty);
+    CHECK(l2.accesses == 5);
+    CHECK(l2.hits == 2);
+  }
+}
+
+TEST_CASE("l2 writes back dirty victims only", "[l2]") {
+  auto dram_config = DramConfig::preset("ddr3-1600").value();
+  dram_config.t_refi = 0;
+  auto dram = DramModel(dram_config);
+  auto l2 = L2Cache(test_config(L2Replacement::lru), &dram);
+
+  // set 0: line 2 clean, line 0 dirty
+  l2.access(0, line_addr(2), 1, false);
+  l2.access(1000, line_addr(0), 1, true);
+  // evicts line 2, clean
+  l2.access(2000, line_addr(4), 1, false);
+  CHECK(l2.writebacks == 0);
+  // evicts line 0
+  l2.access(3000, line_addr(6), 1, false);
+  CHECK(l2.writebacks == 1);
+  // four fills and one write back of a whole line
+  CHECK(dram.get_stats().reads == 4);
+  CHECK(dram.get_stats().writes == 1);
+  CHECK(dram.get_stats().bytes == 5 * line_bytes);
+}
+
+TEST_CASE("l2 replacement policies", "[l2]") {
+  SECTION("lru keeps the line touched last") {
+    auto l2 = L2Cache(test_config(L2Replacement::lru), nullptr);
+    l2.access(0, line_addr(0), 1, false);
+    l2.access(1, line_addr(2), 1, false);
+    l2.access(2, line_addr(0), 1, false);
+    // evicts line 2
+    l2.access(3, line_addr(4), 1, false);
+    CHECK(l2.access(4, line_addr(0), 1, false) == hit_latency);
+    CHECK(l2.access(5, line_addr(2), 1, false) ==
+          hit_latency + miss_penalty);
+  }
+  SECTION("fifo evicts the line filled first") {
+    auto l2 = L2Cache(test_config(L2Replacement::fifo), nullptr);
+    l2.access(0, line_addr(0), 1, false);
+    l2.access(1, line_addr(2), 1, false);
+    l2.access(2, line_addr(0), 1, false);
+    // evicts line 0 although it was just used
+    l2.access(3, line_addr(4), 1, false);
+    CHECK(l2.access(4, line_addr(2), 1, false) == hit_latency);
+    CHECK(l2.access(5, line_addr(0), 1, false) ==
+          hit_latency + miss_penalty);
+  }
+  SECTION("three lines in two ways") {
+    // lru and fifo always evict the next line read, random does not
+    CHECK(thrash_hits(L2Replacement::lru, 100) == 0);
+    CHECK(thrash_hits(L2Replacement::fifo, 100) == 0);
+    CHECK(thrash_hits(L2Replacement::random, 100) > 0);
+  }
+}
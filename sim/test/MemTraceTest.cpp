@@ -0,0 +1,124 @@
+#include "MemTrace.h"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using namespace SimDevices;
+
+namespace {
+std::string trace_path(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// a mix of every op and burst length; cycles and addresses step backwards
+// now and then, like mem_port requests that are recorded one cycle late
+std::vector<MemTraceRecord> make_records(const size_t num) {
+  std::vector<MemTraceRecord> records;
+  uint64_t lcg = 0x9e3779b97f4a7c15ULL;
+  uint64_t cycle = 1000;
+  uint64_t addr = 0x80000000;
+  for (size_t i = 0; i < num; i++) {
+    lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+    MemTraceRecord record;
+    record.op = static_cast<MemTraceOp>(lcg >> 60 & 0x3);
+    record.beats = record.is_burst() ? (lcg >> 56 & 0x7) + 1 : 1;
+    cycle = (lcg >> 40 & 0x7) == 0 ? cycle - 1 : cycle + (lcg >> 32 & 0xff);
+    addr = (lcg >> 43 & 0x3) == 0 ? addr - (lcg >> 8 & 0xfff8)
+                                  : addr + (lcg >> 24 & 0xfff8);
+    record.cycle = cycle;
+    record.addr = addr;
+    record.strb = record.is_write() ? lcg : 0;
+    if (record.beats < MemTraceRecord::max_beats) {
+      // only the strobe bytes of the beats are stored
+      record.strb &= (1ULL << record.beats * 8) - 1;
+    }
+    for (size_t beat = 0; beat < record.beats; beat++) {
+      record.data[beat] = lcg ^ beat * 0x0101010101010101ULL;
+    }
+    records.push_back(record);
+  }
+  return records;
+}
+
+void write_trace(const std::string &path,
+                 const std::vector<MemTraceRecord> &records) {
+  const uint64_t cycle = 0;
+  auto writer = MemTraceWriter(path, &cycle);
+  for (const auto &record : records) {
+    writer.record(record.cycle, record.op, record.addr, record.beats,
+                  record.strb, record.data.data());
+  }
+}
+
+void check_same(const MemTraceRecord &read, const MemTraceRecord &written) {
+  CHECK(read.cycle == written.cycle);
+  CHECK(read.op == written.op);
+  CHECK(read.beats == written.beats);
+  CHECK(read.addr == written.addr);
+  CHECK(read.strb == written.strb);
+  for (size_t beat = 0; beat < written.beats; beat++) {
+    CHECK(read.data[beat] == written.data[beat]);
+  }
+}
+} // namespace
+
+TEST_CASE("mem trace round trip across reader refills", "[mem_trace]") {
+  // about 1.7 MiB, the 1 MiB read buffer is refilled mid record
+  constexpr size_t record_num = 60000;
+  const auto path = trace_path("MemTraceTest.trace");
+  const auto records = make_records(record_num);
+  write_trace(path, records);
+  REQUIRE(std::filesystem::file_size(path) > (1 << 20));
+
+  auto reader = MemTraceReader(path);
+  REQUIRE(reader.is_open());
+  MemTraceRecord read;
+  size_t idx = 0;
+  bool went_back = false;
+  while (reader.next(read)) {
+    REQUIRE(idx < records.size());
+    check_same(read, records[idx]);
+    went_back |= idx > 0 && read.cycle < records[idx - 1].cycle &&
+                 read.addr < records[idx - 1].addr;
+    idx++;
+  }
+  CHECK(idx == records.size());
+  CHECK_FALSE(reader.is_truncated());
+  // the data did exercise negative deltas on both fields
+  CHECK(went_back);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("mem trace reader stops at a truncated record", "[mem_trace]") {
+  const auto path = trace_path("MemTraceTest.truncated.trace");
+  const auto records = make_records(100);
+  write_trace(path, records);
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+  auto reader = MemTraceReader(path);
+  REQUIRE(reader.is_open());
+  MemTraceRecord read;
+  size_t idx = 0;
+  while (reader.next(read)) {
+    check_same(read, records[idx]);
+    idx++;
+  }
+  CHECK(idx == records.size() - 1);
+  CHECK(reader.is_truncated());
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("mem trace reader rejects a file without the magic",
+          "[mem_trace]") {
+  const auto path = trace_path("MemTraceTest.bad.trace");
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a mem trace";
+  }
+  auto reader = MemTraceReader(path);
+  CHECK_FALSE(reader.is_open());
+  MemTraceRecord read;
+  CHECK_FALSE(reader.next(read));
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,55 @@
+#include "TaskScheduler.h"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+// tasks called in cycles [first, last], one string per call
+std::vector<std::string> run_cycles(TaskScheduler &sched,
+                                    std::vector<std::string> &calls,
+                                    const uint64_t first, const uint64_t last) {
+  calls.clear();
+  for (uint64_t cycle = first; cycle <= last; cycle++) {
+    sched.run(cycle);
+  }
+  return calls;
+}
+} // namespace
+
+TEST_CASE("period tasks run on their due cycle", "[task_scheduler]") {
+  auto sched = TaskScheduler();
+  std::vector<uint64_t> due_cycles;
+  uint64_t cycle = 0;
+  sched.add_task({.task_func = [&] { due_cycles.push_back(cycle); },
+                  .name = "every 4",
+                  .period_cycle = 4},
+                 0);
+  for (cycle = 1; cycle <= 12; cycle++) {
+    sched.run(cycle);
+  }
+  CHECK(due_cycles == std::vector<uint64_t>{4, 8, 12});
+}
+
+TEST_CASE("due tasks interleave with every-cycle tasks in registration order",
+          "[task_scheduler]") {
+  auto sched = TaskScheduler();
+  std::vector<std::string> calls;
+  sched.add_task("a", [&] { calls.emplace_back("a"); });
+  sched.add_task({.task_func = [&] { calls.emplace_back("p2"); },
+                  .name = "p2",
+                  .period_cycle = 2},
+                 0);
+  sched.add_task({.task_func = [&] { calls.emplace_back("b"); },
+                  .name = "b",
+                  .period_cycle = 1},
+                 0);
+  sched.add_task({.task_func = [&] { calls.emplace_back("p3"); },
+                  .name = "p3",
+                  .period_cycle = 3},
+                 0);
+
+  CHECK(run_cycles(sched, calls, 1, 1) == std::vector<std::string>{"a", "b"});
+  CHECK(run_cycles(sched, calls, 2, 3) ==
+        std::vector<std::string>{"a", "p2", "b", "a", "b", "p3"});
+  CHECK(sched.get_tasks().size() == 4);
+}
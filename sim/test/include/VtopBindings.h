@@ -0,0 +1,12 @@
+#pragma once
+
+// Stand-in for the VtopBindings.h generated from Vtop.h, for unit tests that
+// use CommitRecord/DiffCommit without a Verilated model. Only the constants
+// are provided, there are no port tables.
+
+#include <cstddef>
+
+namespace VtopBindings {
+constexpr size_t commit_width = 2;
+constexpr size_t gpr_num = 32;
+} // namespace VtopBindings
@@ -31,6 +31,7 @@ add_requires("readerwriterqueue", { system = false })
 add_requires("spdlog", { system = false })
 add_requires("async_simple", { system = false })
 add_requires("capstone_my")
+add_requires("catch2", { system = false })
 -- add_requires("vcpkg::concurrencpp", {system = false})
 
 set_policy("build.warning", true)
@@ -58,8 +59,30 @@ option_end()
 
 
 
+-- generate VtopBindings.h (commit width, GPR/CSR port tables) from the
+-- Verilated Vtop.h, see scripts/gen_vtop_bindings.py
+rule("vtop_bindings")
+	on_config(function (target)
+		target:add("includedirs", path.join(target:autogendir(), "vtop_bindings"))
+	end)
+	before_build(function (target)
+		local vtop_h = os.files(path.join(target:autogendir(), "rules", "verilator", "**", "Vtop.h"))[1]
+		if not vtop_h then
+			raise("Vtop.h not found, verilator has not run yet")
+		end
+		local outdir = path.join(target:autogendir(), "vtop_bindings")
+		os.mkdir(outdir)
+		os.vrunv("python3", {
+			path.join(os.projectdir(), "scripts", "gen_vtop_bindings.py"),
+			vtop_h,
+			path.join(outdir, "VtopBindings.h"),
+		})
+	end)
+rule_end()
+
 target("Vtop")
 	add_rules("verilator.binary")
+	add_rules("vtop_bindings")
 	set_toolchains("@verilator")
 	add_files("src/*.cpp")
 	add_files("src/tasks/*.cpp")
@@ -87,6 +110,29 @@ target("Vtop")
 	add_rpathdirs("$(scriptdir)/ready_to_run")
 
 
+-- accesses/sec through DeviceMange, not built by default: xmake build DeviceBench
+target("DeviceBench")
+	set_kind("binary")
+	set_default(false)
+	add_files("bench/DeviceBench.cpp")
+	add_files("src/DeviceMange.cpp", "src/SramMemoryDev.cpp", "src/ImageCache.cpp")
+	add_files("src/AMUartDev.cpp", "src/AMRTCDev.cpp", "src/DeviceScheduler.cpp")
+	add_files("src/MemTrace.cpp")
+	add_includedirs("src/include/")
+	add_packages("elfio", "spdlog", "async_simple")
+
+-- replays a --mem-trace recording without Vtop: xmake build MemReplay
+target("MemReplay")
+	set_kind("binary")
+	set_default(false)
+	add_files("bench/MemReplay.cpp")
+	add_files("src/DeviceMange.cpp", "src/SramMemoryDev.cpp", "src/ImageCache.cpp")
+	add_files("src/AMUartDev.cpp", "src/AMRTCDev.cpp", "src/DeviceScheduler.cpp")
+	add_files("src/MemTrace.cpp", "src/DramModel.cpp", "src/L2Cache.cpp")
+	add_includedirs("src/include/")
+	add_packages("cli11", "elfio", "spdlog", "async_simple")
+
+
 
 task("wave")
     set_menu {
@@ -126,17 +172,30 @@ task("update_cc")
 	end)
 task_end()
 
--- for _, file in ipairs(os.files("test/*.cpp")) do
---     local name = path.basename(file)
---     target(name)
---         set_kind("binary")
---         set_default(false)
---         add_files(file)
---         add_includedirs("src/include/")
---         add_packages("catch2","assert","elfio")
---         add_tests("default")
---
--- end
+-- unit tests, not built by default: xmake build -g test && xmake test
+-- test/include stands in for the headers generated from Vtop.h
+local unit_tests = {
+	{ "InstDecodeTest" },
+	{ "DiffTestBatchTest", "src/DiffTestBatch.cpp" },
+	{ "MemTraceTest", "src/MemTrace.cpp" },
+	{ "DramModelTest", "src/DramModel.cpp" },
+	{ "L2CacheTest", "src/L2Cache.cpp", "src/DramModel.cpp" },
+	{ "TaskSchedulerTest", "src/TaskScheduler.cpp" },
+}
+for _, unit_test in ipairs(unit_tests) do
+	target(unit_test[1])
+		set_kind("binary")
+		set_default(false)
+		set_group("test")
+		add_files("test/" .. unit_test[1] .. ".cpp")
+		for idx = 2, #unit_test do
+			add_files(unit_test[idx])
+		end
+		add_includedirs("src/include/", "test/include/")
+		add_packages("catch2", "spdlog", "async_simple")
+		add_tests("default")
+	target_end()
+end
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
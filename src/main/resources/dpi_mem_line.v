@@ -0,0 +1,42 @@
+// Simulation only: whole AXI bursts of main memory go to the C++ harness in
+// one DPI-C call, see sim/src/DpiMemory.cpp. A burst is at most 8 beats of
+// 64 bits, beat i lives in line[64*i+63:64*i]. Both calls return the extra
+// cycles the harness' DRAM timing model wants before the data/response, 0
+// without a model.
+
+import "DPI-C" function int dpi_mem_read_line(
+  input longint addr,
+  input int beats,
+  output bit [511:0] line
+);
+
+import "DPI-C" function int dpi_mem_write_line(
+  input longint addr,
+  input int beats,
+  input bit [511:0] line,
+  input longint strb
+);
+
+module dpi_mem_line (
+  input              clock,
+  input              rd_en,
+  input      [63:0]  raddr,
+  input      [7:0]   rbeats,
+  output reg [511:0] rline,
+  output reg [31:0]  rlatency,
+  input              wr_en,
+  input      [63:0]  waddr,
+  input      [7:0]   wbeats,
+  input      [511:0] wline,
+  input      [63:0]  wstrb,
+  output reg [31:0]  wlatency
+);
+  always @(posedge clock) begin
+    if (rd_en) begin
+      rlatency <= dpi_mem_read_line(raddr, {24'b0, rbeats}, rline);
+    end
+    if (wr_en) begin
+      wlatency <= dpi_mem_write_line(waddr, {24'b0, wbeats}, wline, wstrb);
+    end
+  end
+endmodule
@@ -281,6 +281,9 @@ class FishCore(
   // csr <> monitor
   csr_regs.io.direct_read_ports <> monitor.io.csr_monitor
 
+  // lsu <> monitor
+  monitor.io.store_monitor := lsu.io.store_monitor
+
   // csr <> core
   csr_regs.io.mtime := io.mtime
   csr_regs.io.time_int := io.time_int
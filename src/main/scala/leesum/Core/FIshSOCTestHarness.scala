@@ -22,6 +22,12 @@ object MiniFishSocConfig {
   val KBD_ADDR = DEVICE_BASE + 0x0000060L
   val VGACTRL_ADDR = DEVICE_BASE + 0x0000100L
   val FB_ADDR = DEVICE_BASE + 0x0100_0000L
+  // virtio-mmio block device, irq on plic source 1
+  val VIRTIO_BLK_ADDR = DEVICE_BASE + 0x0000_1000L
+  val VIRTIO_BLK_IRQ = 1
+  // the last 4 MiB of RAM bypass the DCache, virtio DMA buffers live here
+  val DMA_POOL_SIZE = 0x0040_0000L
+  val DMA_POOL_ADDR = mem_addr + mem_size - DMA_POOL_SIZE
 
   val CLINT_BASE = 0x0200_0000L
   val PLIC_BASE = 0x0c00_0000L
@@ -31,14 +37,17 @@ object MiniFishSocConfig {
   // 1 -> clint
   // 2 -> plic
   // 3 -> sifive_uart
-  val addr_decode_map = Seq(
+  // 4 -> dpi memory
+  // dpi_mem_en: main memory goes to port 4 instead of the simulated device
+  def addr_decode_map(dpi_mem_en: Boolean) = Seq(
     // simulated device id set to 0
-    (mem_addr, mem_addr + mem_size, 0),
+    (mem_addr, mem_addr + mem_size, if (dpi_mem_en) 4 else 0),
     (SERIAL_PORT, SERIAL_PORT + 0x8, 0),
     (RTC_ADDR, RTC_ADDR + 0x8, 0),
     (KBD_ADDR, KBD_ADDR + 0x8, 0),
     (VGACTRL_ADDR, VGACTRL_ADDR + 0x8, 0),
     (FB_ADDR, FB_ADDR + 300 * 400 * 4, 0),
+    (VIRTIO_BLK_ADDR, VIRTIO_BLK_ADDR + 0x1000, 0),
     // real device
     (CLINT_BASE, CLINT_BASE + 0x1_0000, 1),
     (PLIC_BASE, PLIC_BASE + 0x0400_0000, 2),
@@ -52,11 +61,13 @@ object MiniFishSocConfig {
     boot_pc = 0x80000000L,
     addr_map = Seq(
       (mem_addr, mem_addr + mem_size, false),
+      (DMA_POOL_ADDR, DMA_POOL_ADDR + DMA_POOL_SIZE, true),
       (SERIAL_PORT, SERIAL_PORT + 0x8, true),
       (RTC_ADDR, RTC_ADDR + 0x8, true),
       (KBD_ADDR, KBD_ADDR + 0x8, true),
       (VGACTRL_ADDR, VGACTRL_ADDR + 0x8, true),
       (FB_ADDR, FB_ADDR + 300 * 400 * 4, true),
+      (VIRTIO_BLK_ADDR, VIRTIO_BLK_ADDR + 0x1000, true),
       (CLINT_BASE, CLINT_BASE + 0x1_0000, true),
       (PLIC_BASE, PLIC_BASE + 0x0400_0000, true),
       (SIFIVE_UART_BASE, SIFIVE_UART_BASE + 0x1000, true)
@@ -70,7 +81,11 @@ object MiniFishSocConfig {
   )
 }
 
-class FishSoc() extends Module {
+/** @param dpi_mem_en
+  *   simulation only: main memory bursts go to the harness through DPI-C
+  *   (AXI4DpiMemory) instead of beat by beat over mem_port
+  */
+class FishSoc(dpi_mem_en: Boolean = true) extends Module {
 
   val io = IO(new Bundle {
     val difftest = Output(Valid(new DifftestPort(2)))
@@ -85,22 +100,30 @@ class FishSoc() extends Module {
     val jtag_io = new JtagIO(as_master = false)
     val is_halted = Output(Bool())
     val tohost_addr = Input(ValidIO(UInt(64.W)))
+    // level interrupt of the simulated virtio-blk device
+    val virtio_irq = Input(Bool())
   })
 
+  // the last port is the dummy device
+  val axi_demux_num = 6
   val axi_demux = Module(
-    new AXIDeMux(5, 32, 64)
+    new AXIDeMux(axi_demux_num, 32, 64)
   )
 
   def demux_sel_idx(addr: UInt, en: Bool): UInt = {
 
     val addr_decoder = Module(
-      new AddrDecoder(MiniFishSocConfig.addr_decode_map)
+      new AddrDecoder(MiniFishSocConfig.addr_decode_map(dpi_mem_en))
     )
     addr_decoder.io.addr.valid := en
     addr_decoder.io.addr.bits := addr
 
-    // if addr_decoder.io.sel_error is true, then return dummy device (port 4)
-    Mux(addr_decoder.io.sel_error, 4.U, addr_decoder.io.sel_idx)
+    // if addr_decoder.io.sel_error is true, then return dummy device (port 5)
+    Mux(
+      addr_decoder.io.sel_error,
+      (axi_demux_num - 1).U,
+      addr_decoder.io.sel_idx
+    )
   }
 
   val core = Module(
@@ -176,6 +199,7 @@ class FishSoc() extends Module {
     new plic(harts_map, MiniFishSocConfig.PLIC_BASE.toInt, 15)
   ) // sifive uart irq: 10
   plic32.io.irq_pendings.foreach(_ := false.B)
+  plic32.io.irq_pendings(MiniFishSocConfig.VIRTIO_BLK_IRQ) := io.virtio_irq
 
   core.io.mext_int := plic32.io.harts_ext_irq(0)(0)
   core.io.sext_int := plic32.io.harts_ext_irq(0)(1)
@@ -220,6 +244,21 @@ class FishSoc() extends Module {
   sifive_uart_axi_bridge.io.mem_port <> sifive_uart32to64.io.before
   sifive_uart_axi_bridge.io.axi_slave <> axi_demux.io.out(3)
 
+  // dpi_mem <> axi_demux(4), unused without dpi_mem_en
+  if (dpi_mem_en) {
+    val dpi_mem = Module(new AXI4DpiMemory(32, 64))
+    dpi_mem.io <> axi_demux.io.out(4)
+  } else {
+    val dpi_port = axi_demux.io.out(4)
+    dpi_port.aw.ready := false.B
+    dpi_port.w.ready := false.B
+    dpi_port.b.valid := false.B
+    dpi_port.b.bits := DontCare
+    dpi_port.ar.ready := false.B
+    dpi_port.r.valid := false.B
+    dpi_port.r.bits := DontCare
+  }
+
   // dummy_mem <>  dummy_axi_bridge <> axi_demux(last)
   val dummy_axi_bridge = Module(
     new AXI4SlaveBridge(
@@ -235,10 +274,14 @@ class FishSoc() extends Module {
 
 }
 
+/** --no-dpi-mem: main memory over mem_port, e.g. for a simulator without the
+  * DPI-C memory functions
+  */
 object gen_FishSoc extends App {
   val projectDir = System.getProperty("user.dir")
+  val dpi_mem_en = !args.contains("--no-dpi-mem")
   GenVerilogHelper(
-    new FishSoc(),
+    new FishSoc(dpi_mem_en),
     s"$projectDir/sim/vsrc/ysyx_v2.sv"
   )
 }
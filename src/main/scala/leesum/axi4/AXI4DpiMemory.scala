@@ -0,0 +1,254 @@
+package leesum.axi4
+
+import chisel3._
+import chisel3.util.{Enum, HasBlackBoxResource, is, switch}
+import leesum.GenVerilogHelper
+
+/** DPI-C port into the simulator's main memory, see dpi_mem_line.v
+  */
+class dpi_mem_line extends BlackBox with HasBlackBoxResource {
+  val io = IO(new Bundle {
+    val clock = Input(Clock())
+    val rd_en = Input(Bool())
+    val raddr = Input(UInt(64.W))
+    val rbeats = Input(UInt(8.W))
+    val rline = Output(UInt(512.W))
+    val rlatency = Output(UInt(32.W))
+    val wr_en = Input(Bool())
+    val waddr = Input(UInt(64.W))
+    val wbeats = Input(UInt(8.W))
+    val wline = Input(UInt(512.W))
+    val wstrb = Input(UInt(64.W))
+    val wlatency = Output(UInt(32.W))
+  })
+  addResource("/dpi_mem_line.v")
+}
+
+class DpiMemLineIO extends Bundle {
+  val rd_en = Input(Bool())
+  val raddr = Input(UInt(64.W))
+  val rbeats = Input(UInt(8.W))
+  val rline = Output(UInt(512.W))
+  val rlatency = Output(UInt(32.W))
+  val wr_en = Input(Bool())
+  val waddr = Input(UInt(64.W))
+  val wbeats = Input(UInt(8.W))
+  val wline = Input(UInt(512.W))
+  val wstrb = Input(UInt(64.W))
+  val wlatency = Output(UInt(32.W))
+}
+
+/** Line port behind AXI4DpiMemory: rline and rlatency land the cycle after
+  * rd_en, wlatency the cycle after wr_en.
+  */
+abstract class DpiMemLineBase extends Module {
+  val io = IO(new DpiMemLineIO)
+}
+
+class DpiMemLine extends DpiMemLineBase {
+  val dpi_mem = Module(new dpi_mem_line)
+  dpi_mem.io.clock := clock
+  dpi_mem.io.rd_en := io.rd_en
+  dpi_mem.io.raddr := io.raddr
+  dpi_mem.io.rbeats := io.rbeats
+  dpi_mem.io.wr_en := io.wr_en
+  dpi_mem.io.waddr := io.waddr
+  dpi_mem.io.wbeats := io.wbeats
+  dpi_mem.io.wline := io.wline
+  dpi_mem.io.wstrb := io.wstrb
+  io.rline := dpi_mem.io.rline
+  io.rlatency := dpi_mem.io.rlatency
+  io.wlatency := dpi_mem.io.wlatency
+}
+
+/** Simulation-only AXI4 slave for main memory. A read burst is fetched from
+  * the C++ memory model with one DPI-C call when AR fires, a write burst is
+  * collected and stored with one call after WLAST. The beats themselves still
+  * follow the AXI handshake, only the per-beat BasicMemoryIO traffic to the
+  * harness goes away. Each call also returns how many extra cycles the
+  * harness' DRAM timing model holds back the R data or the B response.
+  *
+  * Only INCR bursts of 8-byte beats (or single beats of any size) up to
+  * max_beats long are supported, which covers the cache refills and write
+  * backs.
+  *
+  * @param mem_line
+  *   the line port, tests swap the DPI-C one for a Chisel model
+  */
+class AXI4DpiMemory(
+    AXI_AW: Int,
+    AXI_DW: Int,
+    mem_line: => DpiMemLineBase = new DpiMemLine
+) extends Module {
+  require(AXI_DW == 64, "AXI_DW must be 64")
+  require(AXI_AW == 32 || AXI_AW == 64, "AXI_AW must be 32 or 64")
+
+  val max_beats = 8
+
+  val io = IO(new AXISlaveIO(AXI_AW, AXI_DW))
+
+  val dpi_mem = Module(mem_line)
+  dpi_mem.io.rd_en := false.B
+  dpi_mem.io.raddr := 0.U
+  dpi_mem.io.rbeats := 0.U
+  dpi_mem.io.wr_en := false.B
+  dpi_mem.io.waddr := 0.U
+  dpi_mem.io.wbeats := 0.U
+
+  def burst_supported(ax: AXIAddressChannel): Bool = {
+    val incr8 = ax.burst === AXIDef.BURST_INCR && ax.size === AXIDef.SIZE_8
+    ax.len === 0.U || (incr8 && ax.len < max_beats.U)
+  }
+
+  ////////////////////////////
+  /// read state machine
+  ////////////////////////////
+  // sRLatency: first cycle after AR, rline and rlatency just landed
+  val sRIdle :: sRLatency :: sRWait :: sRResp :: Nil = Enum(4)
+  val r_state = RegInit(sRIdle)
+  val ar_buf = RegInit(0.U.asTypeOf(new AXIAddressChannel(AXI_AW)))
+  val r_beat = RegInit(0.U(8.W))
+  val r_wait = RegInit(0.U(32.W))
+  val rlatency = dpi_mem.io.rlatency
+
+  io.ar.ready := r_state === sRIdle
+  io.r.valid := r_state === sRResp ||
+    (r_state === sRLatency && rlatency === 0.U)
+  io.r.bits.data := dpi_mem.io.rline
+    .asTypeOf(Vec(max_beats, UInt(64.W)))(r_beat(2, 0))
+  io.r.bits.id := ar_buf.id
+  io.r.bits.resp := 0.U
+  io.r.bits.last := r_beat === ar_buf.len
+  io.r.bits.user := 0.U
+
+  private def send_r_beat(): Unit = {
+    when(io.r.fire) {
+      r_beat := r_beat + 1.U
+      r_state := Mux(io.r.bits.last, sRIdle, sRResp)
+    }
+  }
+
+  switch(r_state) {
+    is(sRIdle) {
+      when(io.ar.fire) {
+        // rline is valid from the next cycle on
+        dpi_mem.io.rd_en := true.B
+        dpi_mem.io.raddr := io.ar.bits.addr
+        dpi_mem.io.rbeats := io.ar.bits.len + 1.U
+        ar_buf := io.ar.bits
+        r_beat := 0.U
+        r_state := sRLatency
+      }
+    }
+    is(sRLatency) {
+      when(rlatency === 0.U) {
+        r_state := sRResp
+        send_r_beat()
+      }.otherwise {
+        r_wait := rlatency - 1.U
+        r_state := Mux(rlatency === 1.U, sRResp, sRWait)
+      }
+    }
+    is(sRWait) {
+      r_wait := r_wait - 1.U
+      when(r_wait === 1.U) {
+        r_state := sRResp
+      }
+    }
+    is(sRResp) {
+      send_r_beat()
+    }
+  }
+
+  ////////////////////////////
+  /// write state machine
+  ////////////////////////////
+  // sWLatency: first cycle after the burst was stored, wlatency just landed
+  val sWIdle :: sWData :: sWCommit :: sWLatency :: sWWait :: sWResp :: Nil =
+    Enum(6)
+  val w_state = RegInit(sWIdle)
+  val aw_buf = RegInit(0.U.asTypeOf(new AXIAddressChannel(AXI_AW)))
+  val w_beat = RegInit(0.U(8.W))
+  val wline = RegInit(VecInit(Seq.fill(max_beats)(0.U(64.W))))
+  val wstrb = RegInit(VecInit(Seq.fill(max_beats)(0.U(8.W))))
+  val w_wait = RegInit(0.U(32.W))
+  val wlatency = dpi_mem.io.wlatency
+
+  io.aw.ready := w_state === sWIdle
+  io.w.ready := w_state === sWData
+  io.b.valid := w_state === sWResp ||
+    (w_state === sWLatency && wlatency === 0.U)
+  io.b.bits.id := aw_buf.id
+  io.b.bits.resp := 0.U
+  io.b.bits.user := 0.U
+
+  dpi_mem.io.wline := wline.asUInt
+  dpi_mem.io.wstrb := wstrb.asUInt
+
+  switch(w_state) {
+    is(sWIdle) {
+      when(io.aw.fire) {
+        aw_buf := io.aw.bits
+        w_beat := 0.U
+        wstrb.foreach(_ := 0.U)
+        w_state := sWData
+      }
+    }
+    is(sWData) {
+      when(io.w.fire) {
+        wline(w_beat(2, 0)) := io.w.bits.data
+        wstrb(w_beat(2, 0)) := io.w.bits.strb
+        w_beat := w_beat + 1.U
+        when(io.w.bits.last) {
+          w_state := sWCommit
+        }
+      }
+    }
+    is(sWCommit) {
+      // the whole burst goes out in one call, B is sent once it landed
+      dpi_mem.io.wr_en := true.B
+      dpi_mem.io.waddr := aw_buf.addr
+      dpi_mem.io.wbeats := aw_buf.len + 1.U
+      w_state := sWLatency
+    }
+    is(sWLatency) {
+      when(wlatency === 0.U) {
+        w_state := Mux(io.b.fire, sWIdle, sWResp)
+      }.otherwise {
+        w_wait := wlatency - 1.U
+        w_state := Mux(wlatency === 1.U, sWResp, sWWait)
+      }
+    }
+    is(sWWait) {
+      w_wait := w_wait - 1.U
+      when(w_wait === 1.U) {
+        w_state := sWResp
+      }
+    }
+    is(sWResp) {
+      when(io.b.fire) {
+        w_state := sWIdle
+      }
+    }
+  }
+
+  // --------------------------
+  // assertion
+  // --------------------------
+  when(io.ar.fire) {
+    assert(burst_supported(io.ar.bits), "unsupported read burst")
+  }
+  when(io.aw.fire) {
+    assert(burst_supported(io.aw.bits), "unsupported write burst")
+  }
+  when(io.w.fire) {
+    assert(
+      io.w.bits.last === (w_beat === aw_buf.len),
+      "wlast does not match awlen"
+    )
+  }
+}
+
+object gen_AXI4DpiMemory_verilog extends App {
+  GenVerilogHelper(new AXI4DpiMemory(32, 64))
+}
@@ -1,9 +1,10 @@
 package leesum.lsu
 
 import chisel3._
-import chisel3.util.{Arbiter, Decoupled}
+import chisel3.util.{Arbiter, Decoupled, Valid}
 import leesum.Cache.{LoadDcacheReq, LoadDcacheResp, StoreDcacheReq, StoreDcacheResp}
 import leesum._
+import leesum.moniter.StoreMonitorPort
 
 class LSUReq extends AGUReq {}
 class LSUResp extends Bundle {
@@ -33,6 +34,7 @@ class LSUTop() extends Module {
     val store_commit = Flipped(Decoupled(Bool()))
     val amo_commit = Flipped(Decoupled(Bool()))
     val store_queue_empty = Output(Bool())
+    val store_monitor = Output(Valid(new StoreMonitorPort))
 
     val lsu_resp = Decoupled(new LSUResp)
     val agu_writeback = Decoupled(new AGUWriteBack)
@@ -112,6 +114,7 @@ class LSUTop() extends Module {
 
   // store queue <> commit
   store_queue.io.store_commit <> io.store_commit
+  io.store_monitor := store_queue.io.store_monitor
   // agu queue <> commit
   amo_queue.io.amo_commit <> io.amo_commit
 
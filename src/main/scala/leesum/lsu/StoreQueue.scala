@@ -5,6 +5,7 @@ import chisel3.util.{Decoupled, Enum, Mux1H, PopCount, Valid, is, isPow2, switch
 import leesum.Cache.{StoreDcacheReq, StoreDcacheResp}
 import leesum.GenVerilogHelper
 import leesum.Utils.MultiPortFIFOBase
+import leesum.moniter.StoreMonitorPort
 
 class StoreQueueIn extends Bundle {
   val wdata = UInt(64.W)
@@ -50,6 +51,8 @@ class StoreQueue(
     val dcache_resp = Flipped(Decoupled(new StoreDcacheResp))
     val store_bypass = new StoreBypassIO
     val st_queue_empty = Output(Bool())
+    // committed store, for difftest
+    val store_monitor = Output(Valid(new StoreMonitorPort))
   })
 
   // --------------------------
@@ -170,6 +173,12 @@ class StoreQueue(
 
 //  io.store_commit.ready := !speculate_fifo_empty && !commit_fifo_full
 
+  val commit_entry = speculate_store_fifo.peek().head.bits
+  io.store_monitor.valid := io.store_commit.fire && !commit_entry.is_mmio
+  io.store_monitor.bits.paddr := commit_entry.paddr
+  io.store_monitor.bits.wdata := commit_entry.wdata
+  io.store_monitor.bits.wstrb := commit_entry.wstrb
+
   // ----------------------
   // store bypass logic
   // ----------------------
@@ -26,6 +26,13 @@ class InstPort extends Bundle {
   val is_rvc = Bool()
 }
 
+// a committed store as it leaves the speculative store queue
+class StoreMonitorPort extends Bundle {
+  val paddr = UInt(64.W)
+  val wdata = UInt(64.W)
+  val wstrb = UInt(8.W)
+}
+
 class DifftestPort(commit_port_num: Int) extends Bundle {
   // inst info
   val inst_info = Vec(commit_port_num, new InstPort)
@@ -38,6 +45,8 @@ class DifftestPort(commit_port_num: Int) extends Bundle {
   val contain_mmio = Bool()
   val has_interrupt = Bool()
   val csr_skip = Bool()
+  // committed store of this cycle, mmio stores are not reported
+  val store = Valid(new StoreMonitorPort)
   // csr port
   val csr = new CSRDirectReadPorts
   // gpr port
@@ -61,6 +70,7 @@ class MonitorTop(commit_port_num: Int) extends Module {
       Vec(commit_port_num, Flipped(Valid(new CommitMonitorPort)))
     val gpr_monitor = Input(new GERMonitorPort)
     val csr_monitor = Input(new CSRDirectReadPorts)
+    val store_monitor = Input(Valid(new StoreMonitorPort))
     val difftest = Output(Valid(new DifftestPort(commit_port_num)))
     // perf monitor
     val perf_bp = Input(new PerfMonitorCounter)
@@ -88,6 +98,8 @@ class MonitorTop(commit_port_num: Int) extends Module {
   // delay 1 cycle to wait for gpr write back
   val commit_monitor_next = RegNext(io.commit_monitor)
   val commit_monitor_count = PopCount(commit_monitor_next.map(_.valid))
+  // store commit fires with the rob commit, keep them in the same cycle
+  val store_monitor_next = RegNext(io.store_monitor)
 
   val last_commit_inst = PriorityMux(
     commit_monitor_next.map(_.valid).reverse,
@@ -118,6 +130,7 @@ class MonitorTop(commit_port_num: Int) extends Module {
   io.difftest.bits.contain_mmio := contain_mmio & !last_exception.valid
   io.difftest.bits.has_interrupt := has_interrupt & !last_exception.valid
   io.difftest.bits.csr_skip := csr_skip & !last_exception.valid
+  io.difftest.bits.store := store_monitor_next
 
   for (i <- 0 until commit_port_num) {
     io.difftest.bits.inst_info(i).pc := commit_monitor_next(i).bits.pc
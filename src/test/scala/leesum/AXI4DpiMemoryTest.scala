@@ -0,0 +1,149 @@
+package leesum
+import chisel3._
+import chisel3.experimental.BundleLiterals.AddBundleLiteralConstructor
+import chisel3.util.{FillInterleaved, log2Ceil}
+import chiseltest._
+import leesum.axi4.AXIDef.{BURST_INCR, SIZE_8}
+import leesum.axi4._
+import org.scalatest.freespec.AnyFreeSpec
+
+/** Chisel stand-in for the dpi_mem_line blackbox, word i starts as 0x1000 + i
+  * and every call takes latency extra cycles.
+  */
+class DpiMemLineModel(words: Int, latency: Int) extends DpiMemLineBase {
+  require(words >= 8 && (words & (words - 1)) == 0, "words must be 2^n >= 8")
+  val idx_width = log2Ceil(words)
+
+  val mem = RegInit(VecInit(Seq.tabulate(words)(i => (0x1000 + i).U(64.W))))
+  val rline = RegInit(0.U(512.W))
+  val rlatency = RegInit(0.U(32.W))
+  val wlatency = RegInit(0.U(32.W))
+
+  def word_idx(addr: UInt, beat: Int): UInt =
+    (addr(idx_width + 2, 3) + beat.U)(idx_width - 1, 0)
+
+  when(io.rd_en) {
+    rline := VecInit(Seq.tabulate(8)(b => mem(word_idx(io.raddr, b)))).asUInt
+    rlatency := latency.U
+  }
+  when(io.wr_en) {
+    for (b <- 0 until 8) {
+      when(b.U < io.wbeats) {
+        val idx = word_idx(io.waddr, b)
+        val mask = FillInterleaved(8, io.wstrb(8 * b + 7, 8 * b))
+        val data = io.wline(64 * b + 63, 64 * b)
+        mem(idx) := (mem(idx) & ~mask) | (data & mask)
+      }
+    }
+    wlatency := latency.U
+  }
+
+  io.rline := rline
+  io.rlatency := rlatency
+  io.wlatency := wlatency
+}
+
+class AXI4DpiMemoryTest extends AnyFreeSpec with ChiselScalatestTester {
+  val AXI_AW = 32
+  val AXI_DW = 64
+
+  def addr_channel(addr: Int, len: Int, id: Int) =
+    new AXIAddressChannel(AXI_AW).Lit(
+      _.id -> id.U,
+      _.addr -> addr.U,
+      _.len -> len.U,
+      _.size -> SIZE_8,
+      _.burst -> BURST_INCR,
+      _.lock -> 0.U,
+      _.cache -> 0.U,
+      _.prot -> 0.U,
+      _.qos -> 0.U,
+      _.region -> 0.U,
+      _.user -> 0.U
+    )
+
+  def w_beat(data: String, strb: Int, last: Boolean) =
+    new AXIWriteDataChannel(AXI_DW).Lit(
+      _.data -> data.U,
+      _.strb -> strb.U,
+      _.last -> last.B,
+      _.user -> 0.U
+    )
+
+  def r_beat(data: String, last: Boolean, id: Int) =
+    new AXIReadDataChannel(AXI_DW).Lit(
+      _.data -> data.U,
+      _.resp -> 0.U,
+      _.last -> last.B,
+      _.user -> 0.U,
+      _.id -> id.U
+    )
+
+  Seq(0, 3).foreach { latency =>
+    s"2-beat write back and read, dpi latency $latency" in {
+      test(new AXI4DpiMemory(AXI_AW, AXI_DW, new DpiMemLineModel(64, latency)))
+        .withAnnotations(
+          Seq(VerilatorBackendAnnotation, WriteFstAnnotation)
+        ) { dut =>
+          dut.io.ar.initSource()
+          dut.io.ar.setSourceClock(dut.clock)
+          dut.io.r.initSink()
+          dut.io.r.setSinkClock(dut.clock)
+          dut.io.aw.initSource()
+          dut.io.aw.setSourceClock(dut.clock)
+          dut.io.w.initSource()
+          dut.io.w.setSourceClock(dut.clock)
+          dut.io.b.initSink()
+          dut.io.b.setSinkClock(dut.clock)
+          dut.clock.step(5)
+
+          // the line at 0x40 before the write back: words 8 and 9
+          dut.io.ar.enqueue(addr_channel(0x40, 1, 1))
+          dut.io.r.expectDequeueSeq(
+            Seq(
+              r_beat("x1008", last = false, id = 1),
+              r_beat("x1009", last = true, id = 1)
+            )
+          )
+
+          // write back, the second beat only writes its low half
+          dut.io.aw.enqueue(addr_channel(0x40, 1, 2))
+          dut.io.w.enqueueSeq(
+            Seq(
+              w_beat("x0123456789abcdef", 0xff, last = false),
+              w_beat("x1122334455667788", 0x0f, last = true)
+            )
+          )
+          var b_cycles = 0
+          while (!dut.io.b.valid.peek().litToBoolean) {
+            dut.clock.step()
+            b_cycles += 1
+          }
+          // one cycle for the burst to go out, then the dpi latency
+          assert(b_cycles > latency)
+          dut.io.b.expectDequeue(
+            new AXIWriteResponseChannel().Lit(
+              _.id -> 2.U,
+              _.resp -> 0.U,
+              _.user -> 0.U
+            )
+          )
+
+          dut.io.ar.enqueue(addr_channel(0x40, 1, 3))
+          var r_cycles = 0
+          while (!dut.io.r.valid.peek().litToBoolean) {
+            dut.clock.step()
+            r_cycles += 1
+          }
+          assert(r_cycles >= latency)
+          dut.io.r.expectDequeueSeq(
+            Seq(
+              r_beat("x0123456789abcdef", last = false, id = 3),
+              r_beat("x0000000055667788", last = true, id = 3)
+            )
+          )
+          dut.clock.step(5)
+        }
+    }
+  }
+}